@@ -0,0 +1,477 @@
+// Load generator for chat_server. Opens many concurrent connections,
+// spreads them over groups, sends at a target rate and measures
+// send-to-delivery latency from timestamps embedded in each message.
+//
+//   ./chat_bench --clients=1000 --groups=50 --rate=20000 --duration=10
+//
+// Results go to stdout as a single JSON object (or text with --format=text).
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "../shared/protocol.h"
+#include "../shared/frame.h"
+
+struct BenchConfig {
+    std::string host;
+    int port;
+    size_t clients;
+    size_t groups;
+    std::string distribution; // uniform | zipf
+    double zipfExponent;
+    double rate;              // messages per second, all clients together
+    double duration;          // seconds of measured sending
+    double warmup;            // seconds of sending excluded from results
+    size_t payloadBytes;
+    size_t threads;
+    WireVersion wireVersion;
+    std::string format;       // json | text
+
+    BenchConfig()
+        : host("127.0.0.1"), port(8080), clients(100), groups(10), distribution("uniform"),
+          zipfExponent(1.0), rate(1000), duration(10), warmup(1), payloadBytes(64),
+          threads(2), wireVersion(WIRE_V2), format("json") {}
+};
+
+static uint64_t monotonicNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct BenchClient {
+    int fd;
+    uint16_t groupID;
+    std::vector<char> inBuffer;
+    std::string outBuffer;
+    bool wantWrite;
+
+    BenchClient() : fd(-1), groupID(0), wantWrite(false) {}
+};
+
+// Per-thread results, merged at the end
+struct WorkerResult {
+    uint64_t sent;
+    uint64_t acked;
+    uint64_t errors;
+    uint64_t delivered;
+    std::vector<uint32_t> latenciesMicros;
+
+    WorkerResult() : sent(0), acked(0), errors(0), delivered(0) {}
+};
+
+static bool sendAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+// Blocking read of exactly one frame, used during setup only
+static bool readFrame(int fd, std::vector<char>& buffer, WireVersion version, ChatPacket& packet) {
+    char chunk[4096];
+    while (true) {
+        long consumed = decodeFrame(buffer.data(), buffer.size(), version, packet);
+        if (consumed < 0) return false;
+        if (consumed > 0) {
+            buffer.erase(buffer.begin(), buffer.begin() + consumed);
+            return true;
+        }
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.insert(buffer.end(), chunk, chunk + n);
+    }
+}
+
+static bool sendFrame(int fd, const ChatPacket& packet, WireVersion version) {
+    Frame frame(packet, version);
+    return sendAll(fd, frame.data(), frame.size());
+}
+
+// Wait for the reply to a request, skipping pushed traffic (history etc.)
+static bool awaitReply(int fd, std::vector<char>& buffer, WireVersion version, ChatPacket& reply) {
+    while (readFrame(fd, buffer, version, reply)) {
+        if (reply.type == MSG_ACK || reply.type == MSG_ERROR) return true;
+    }
+    return false;
+}
+
+static int connectClient(const BenchConfig& config, std::vector<char>& buffer) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (inet_pton(AF_INET, config.host.c_str(), &address.sin_addr) <= 0 ||
+        connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (config.wireVersion == WIRE_V2) {
+        ChatPacket hello;
+        hello.type = MSG_HELLO;
+        hello.payload[0] = static_cast<char>(WIRE_V2);
+        hello.payloadSize = 1;
+        ChatPacket reply;
+        if (!sendFrame(fd, hello, WIRE_LEGACY) || !readFrame(fd, buffer, WIRE_LEGACY, reply) ||
+            reply.type != MSG_HELLO || reply.payload[0] != WIRE_V2) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Group index for each client according to the size distribution
+static std::vector<size_t> assignGroups(const BenchConfig& config) {
+    std::vector<size_t> assignment(config.clients);
+    std::mt19937 rng(42);
+
+    if (config.distribution == "zipf") {
+        std::vector<double> weights(config.groups);
+        for (size_t g = 0; g < config.groups; ++g) {
+            weights[g] = 1.0 / std::pow(static_cast<double>(g + 1), config.zipfExponent);
+        }
+        std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+        for (size_t i = 0; i < config.clients; ++i) {
+            assignment[i] = pick(rng);
+        }
+    } else {
+        for (size_t i = 0; i < config.clients; ++i) {
+            assignment[i] = i % config.groups;
+        }
+    }
+    return assignment;
+}
+
+static void queueFrame(BenchClient& client, const ChatPacket& packet, WireVersion version) {
+    Frame frame(packet, version);
+    client.outBuffer.append(frame.data(), frame.size());
+}
+
+static bool flushClient(BenchClient& client) {
+    while (!client.outBuffer.empty()) {
+        ssize_t sent = send(client.fd, client.outBuffer.data(), client.outBuffer.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            if (errno == EINTR) continue;
+            return false;
+        }
+        client.outBuffer.erase(0, sent);
+    }
+    return true;
+}
+
+static void drainClient(BenchClient& client, WireVersion version, uint64_t measureFrom,
+                        WorkerResult& result) {
+    char chunk[16384];
+    while (true) {
+        ssize_t n = recv(client.fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            client.inBuffer.insert(client.inBuffer.end(), chunk, chunk + n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        break;
+    }
+
+    uint64_t now = monotonicNanos();
+    size_t offset = 0;
+    while (offset < client.inBuffer.size()) {
+        ChatPacket packet;
+        long consumed = decodeFrame(client.inBuffer.data() + offset,
+                                    client.inBuffer.size() - offset, version, packet);
+        if (consumed <= 0) break;
+        offset += consumed;
+
+        if (packet.type == MSG_ACK) {
+            result.acked++;
+        } else if (packet.type == MSG_ERROR) {
+            result.errors++;
+        } else if (packet.type == MSG_TEXT) {
+            unsigned long long sentAt = 0;
+            if (sscanf(packet.payload, "t=%llx", &sentAt) == 1 && sentAt >= measureFrom) {
+                result.delivered++;
+                uint64_t micros = (now > sentAt) ? (now - sentAt) / 1000 : 0;
+                result.latenciesMicros.push_back(static_cast<uint32_t>(
+                    std::min<uint64_t>(micros, UINT32_MAX)));
+            }
+        }
+    }
+    client.inBuffer.erase(client.inBuffer.begin(), client.inBuffer.begin() + offset);
+}
+
+// One worker drives a slice of the clients: it paces sends for them and
+// reads everything they receive
+static void runWorker(const BenchConfig& config, std::vector<BenchClient*> clients,
+                      uint64_t startAt, uint64_t measureFrom, uint64_t stopSendingAt,
+                      uint64_t stopAt, WorkerResult& result) {
+    int epollFd = epoll_create1(0);
+    for (size_t i = 0; i < clients.size(); ++i) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, clients[i]->fd, &ev);
+    }
+
+    double share = static_cast<double>(clients.size()) / config.clients;
+    double rate = config.rate * share;
+    uint64_t scheduled = 0;
+    size_t nextClient = 0;
+    std::string filler(config.payloadBytes > 19 ? config.payloadBytes - 19 : 0, 'x');
+    struct epoll_event events[256];
+
+    while (true) {
+        uint64_t now = monotonicNanos();
+        if (now >= stopAt) break;
+
+        // Send everything due by now, round-robin over our clients
+        if (now < stopSendingAt && now >= startAt && !clients.empty()) {
+            uint64_t due = static_cast<uint64_t>((now - startAt) / 1e9 * rate);
+            while (scheduled < due) {
+                size_t index = nextClient;
+                BenchClient& client = *clients[index];
+                nextClient = (nextClient + 1) % clients.size();
+
+                ChatPacket packet;
+                packet.type = MSG_TEXT;
+                packet.groupID = client.groupID;
+                int length = snprintf(packet.payload, sizeof(packet.payload), "t=%016llx %s",
+                                      static_cast<unsigned long long>(monotonicNanos()),
+                                      filler.c_str());
+                packet.payloadSize = static_cast<uint16_t>(
+                    std::min<int>(length, static_cast<int>(sizeof(packet.payload)) - 1));
+                queueFrame(client, packet, config.wireVersion);
+                scheduled++;
+                result.sent++;
+
+                if (!flushClient(client)) continue;
+                if (!client.outBuffer.empty() && !client.wantWrite) {
+                    struct epoll_event ev;
+                    ev.events = EPOLLIN | EPOLLOUT;
+                    ev.data.u64 = index;
+                    epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &ev);
+                    client.wantWrite = true;
+                }
+            }
+        }
+
+        int n = epoll_wait(epollFd, events, 256, 1);
+        for (int i = 0; i < n; ++i) {
+            BenchClient& client = *clients[events[i].data.u64];
+            if (events[i].events & EPOLLOUT) {
+                flushClient(client);
+                if (client.outBuffer.empty()) {
+                    struct epoll_event ev;
+                    ev.events = EPOLLIN;
+                    ev.data.u64 = events[i].data.u64;
+                    epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &ev);
+                    client.wantWrite = false;
+                }
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                drainClient(client, config.wireVersion, measureFrom, result);
+            }
+        }
+    }
+    close(epollFd);
+}
+
+static double percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = static_cast<size_t>(std::ceil(p * sorted.size())) - 1;
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+static bool parseArgs(int argc, char* argv[], BenchConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) return false;
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+
+        if (name == "host") config.host = value;
+        else if (name == "port") config.port = atoi(value.c_str());
+        else if (name == "clients") config.clients = strtoul(value.c_str(), nullptr, 10);
+        else if (name == "groups") config.groups = strtoul(value.c_str(), nullptr, 10);
+        else if (name == "group-dist") config.distribution = value;
+        else if (name == "zipf-s") config.zipfExponent = atof(value.c_str());
+        else if (name == "rate") config.rate = atof(value.c_str());
+        else if (name == "duration") config.duration = atof(value.c_str());
+        else if (name == "warmup") config.warmup = atof(value.c_str());
+        else if (name == "payload") config.payloadBytes = strtoul(value.c_str(), nullptr, 10);
+        else if (name == "threads") config.threads = strtoul(value.c_str(), nullptr, 10);
+        else if (name == "protocol") config.wireVersion = (value == "legacy") ? WIRE_LEGACY : WIRE_V2;
+        else if (name == "format") config.format = value;
+        else return false;
+    }
+    return config.clients > 0 && config.groups > 0 && config.threads > 0 &&
+           (config.distribution == "uniform" || config.distribution == "zipf");
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    if (!parseArgs(argc, argv, config)) {
+        std::cerr << "Usage: " << argv[0] << " [--host=H] [--port=P] [--clients=N] [--groups=G]\n"
+                  << "       [--group-dist=uniform|zipf] [--zipf-s=S] [--rate=MSGS_PER_SEC]\n"
+                  << "       [--duration=SEC] [--warmup=SEC] [--payload=BYTES] [--threads=T]\n"
+                  << "       [--protocol=v2|legacy] [--format=json|text]" << std::endl;
+        return 1;
+    }
+
+    // Connect everyone, create the groups we need, then join
+    std::vector<BenchClient> clients(config.clients);
+    std::vector<std::vector<char>> setupBuffers(config.clients);
+    for (size_t i = 0; i < config.clients; ++i) {
+        clients[i].fd = connectClient(config, setupBuffers[i]);
+        if (clients[i].fd < 0) {
+            std::cerr << "Connection " << i << " failed" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<uint16_t> groupIDs;
+    for (size_t g = 0; g < config.groups; ++g) {
+        ChatPacket create;
+        create.type = MSG_CREATE_GROUP;
+        create.payloadSize = static_cast<uint16_t>(
+            snprintf(create.payload, sizeof(create.payload), "bench-%zu", g));
+        ChatPacket reply;
+        if (!sendFrame(clients[0].fd, create, config.wireVersion) ||
+            !awaitReply(clients[0].fd, setupBuffers[0], config.wireVersion, reply) ||
+            reply.type != MSG_ACK) {
+            std::cerr << "Group creation failed" << std::endl;
+            return 1;
+        }
+        groupIDs.push_back(reply.groupID);
+    }
+
+    std::vector<size_t> assignment = assignGroups(config);
+    std::vector<size_t> groupSizes(config.groups, 0);
+    for (size_t i = 0; i < config.clients; ++i) {
+        ChatPacket join;
+        join.type = MSG_JOIN_GROUP;
+        join.groupID = groupIDs[assignment[i]];
+        clients[i].groupID = join.groupID;
+        groupSizes[assignment[i]]++;
+
+        ChatPacket reply;
+        if (!sendFrame(clients[i].fd, join, config.wireVersion) ||
+            !awaitReply(clients[i].fd, setupBuffers[i], config.wireVersion, reply) ||
+            reply.type != MSG_ACK) {
+            std::cerr << "Join failed for client " << i << std::endl;
+            return 1;
+        }
+        clients[i].inBuffer = setupBuffers[i];
+        fcntl(clients[i].fd, F_SETFL, fcntl(clients[i].fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    // Every message is delivered to the other members of its group
+    double expectedFanout = 0;
+    for (size_t i = 0; i < config.clients; ++i) {
+        expectedFanout += groupSizes[assignment[i]] - 1;
+    }
+    expectedFanout /= config.clients;
+
+    uint64_t startAt = monotonicNanos() + 100000000ULL;
+    uint64_t measureFrom = startAt + static_cast<uint64_t>(config.warmup * 1e9);
+    uint64_t stopSendingAt = measureFrom + static_cast<uint64_t>(config.duration * 1e9);
+    uint64_t stopAt = stopSendingAt + 2000000000ULL; // let in-flight deliveries land
+
+    size_t threadCount = std::min(config.threads, config.clients);
+    std::vector<WorkerResult> results(threadCount);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threadCount; ++t) {
+        std::vector<BenchClient*> slice;
+        for (size_t i = t; i < config.clients; i += threadCount) {
+            slice.push_back(&clients[i]);
+        }
+        workers.emplace_back(runWorker, std::cref(config), slice, startAt, measureFrom,
+                             stopSendingAt, stopAt, std::ref(results[t]));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto& client : clients) {
+        close(client.fd);
+    }
+
+    WorkerResult total;
+    for (auto& result : results) {
+        total.sent += result.sent;
+        total.acked += result.acked;
+        total.errors += result.errors;
+        total.delivered += result.delivered;
+        total.latenciesMicros.insert(total.latenciesMicros.end(),
+                                     result.latenciesMicros.begin(), result.latenciesMicros.end());
+    }
+    std::sort(total.latenciesMicros.begin(), total.latenciesMicros.end());
+
+    double mean = 0;
+    for (uint32_t latency : total.latenciesMicros) mean += latency;
+    if (!total.latenciesMicros.empty()) mean /= total.latenciesMicros.size();
+    uint32_t maxLatency = total.latenciesMicros.empty() ? 0 : total.latenciesMicros.back();
+    size_t largestGroup = *std::max_element(groupSizes.begin(), groupSizes.end());
+
+    std::ostringstream out;
+    if (config.format == "text") {
+        out << "clients " << config.clients << ", groups " << config.groups
+            << " (" << config.distribution << ", largest " << largestGroup << ")\n"
+            << "sent " << total.sent << ", acked " << total.acked << ", errors " << total.errors
+            << ", delivered (measured) " << total.delivered << "\n"
+            << "delivery rate " << total.delivered / config.duration << " msg/s, "
+            << "expected fan-out " << expectedFanout << "\n"
+            << "latency us: p50 " << percentile(total.latenciesMicros, 0.50)
+            << "  p99 " << percentile(total.latenciesMicros, 0.99)
+            << "  p999 " << percentile(total.latenciesMicros, 0.999)
+            << "  max " << maxLatency << "  mean " << mean << "\n";
+    } else {
+        out << "{\"clients\":" << config.clients
+            << ",\"groups\":" << config.groups
+            << ",\"group_dist\":\"" << config.distribution << "\""
+            << ",\"largest_group\":" << largestGroup
+            << ",\"protocol\":\"" << (config.wireVersion == WIRE_V2 ? "v2" : "legacy") << "\""
+            << ",\"payload_bytes\":" << config.payloadBytes
+            << ",\"target_rate\":" << config.rate
+            << ",\"duration_s\":" << config.duration
+            << ",\"sent\":" << total.sent
+            << ",\"acked\":" << total.acked
+            << ",\"errors\":" << total.errors
+            << ",\"delivered\":" << total.delivered
+            << ",\"expected_fanout\":" << expectedFanout
+            << ",\"delivery_rate\":" << total.delivered / config.duration
+            << ",\"latency_us\":{\"p50\":" << percentile(total.latenciesMicros, 0.50)
+            << ",\"p99\":" << percentile(total.latenciesMicros, 0.99)
+            << ",\"p999\":" << percentile(total.latenciesMicros, 0.999)
+            << ",\"max\":" << maxLatency
+            << ",\"mean\":" << mean << "}}\n";
+    }
+    std::cout << out.str();
+    return 0;
+}
@@ -0,0 +1,452 @@
+// Microbenchmarks for the shared server components. Each benchmark runs a
+// fixed number of operations per thread with fixed seeds, sweeping thread
+// counts, and reports throughput plus heap allocations per operation.
+//
+//   ./chat_microbench                       # everything, threads 1,2,4,8
+//   ./chat_microbench --filter=cache --threads=1,4 --ops=200000
+//
+// Output is a text table, or one JSON object per line with --format=json.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "../shared/protocol.h"
+#include "../shared/cache.h"
+#include "../shared/frame.h"
+#include "../shared/utils.h"
+#include "../server/thread_pool.cpp"
+#include "../server/group_manager.cpp"
+#include "../server/content_filter.cpp"
+
+// Count every heap allocation in the process
+static std::atomic<uint64_t> allocationCount(0);
+
+// Every replacement new/delete goes through this pair. free() sits behind
+// a call GCC does not inline, so it cannot mistake the pairing of the
+// replaced operators for a new/free mismatch (-Wmismatched-new-delete).
+static void* countedAllocate(size_t size, size_t align) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    void* p = (align <= alignof(std::max_align_t))
+        ? malloc(size)
+        : aligned_alloc(align, (size + align - 1) & ~(align - 1));
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) static void countedRelease(void* p) noexcept {
+    free(p);
+}
+
+void* operator new(size_t size) { return countedAllocate(size, 0); }
+void* operator new[](size_t size) { return countedAllocate(size, 0); }
+void* operator new(size_t size, std::align_val_t align) {
+    return countedAllocate(size, static_cast<size_t>(align));
+}
+void* operator new[](size_t size, std::align_val_t align) {
+    return countedAllocate(size, static_cast<size_t>(align));
+}
+
+void operator delete(void* p) noexcept { countedRelease(p); }
+void operator delete[](void* p) noexcept { countedRelease(p); }
+void operator delete(void* p, size_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, size_t) noexcept { countedRelease(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countedRelease(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { countedRelease(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { countedRelease(p); }
+
+struct BenchOptions {
+    std::vector<size_t> threadCounts;
+    size_t opsPerThread;
+    std::string filter;
+    bool json;
+
+    BenchOptions() : threadCounts{1, 2, 4, 8}, opsPerThread(100000), json(false) {}
+};
+
+struct BenchResult {
+    std::string name;
+    size_t threads;
+    uint64_t ops;
+    double seconds;
+    uint64_t allocations;
+};
+
+static void report(const BenchOptions& options, const BenchResult& result) {
+    double opsPerSec = result.seconds > 0 ? result.ops / result.seconds : 0;
+    double allocsPerOp = result.ops > 0 ? static_cast<double>(result.allocations) / result.ops : 0;
+    double nsPerOp = result.ops > 0 ? result.seconds * 1e9 / result.ops * result.threads : 0;
+
+    std::ostringstream out;
+    if (options.json) {
+        out << "{\"bench\":\"" << result.name << "\",\"threads\":" << result.threads
+            << ",\"ops\":" << result.ops << ",\"seconds\":" << result.seconds
+            << ",\"ops_per_sec\":" << opsPerSec << ",\"ns_per_op\":" << nsPerOp
+            << ",\"allocs_per_op\":" << allocsPerOp << "}";
+    } else {
+        char line[160];
+        snprintf(line, sizeof(line), "%-36s %3zu thr %14.0f ops/s %10.1f ns/op %8.2f allocs/op",
+                 result.name.c_str(), result.threads, opsPerSec, nsPerOp, allocsPerOp);
+        out << line;
+    }
+    std::cout << out.str() << std::endl;
+}
+
+// Start all threads together, time the slowest, count allocations made
+// while the body runs. body(threadIndex) performs opsPerThread operations.
+static BenchResult runThreads(const std::string& name, size_t threads, uint64_t totalOps,
+                              const std::function<void(size_t)>& body) {
+    std::atomic<size_t> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            body(t);
+        });
+    }
+    while (ready.load() < threads) std::this_thread::yield();
+
+    uint64_t allocationsBefore = allocationCount.load();
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) worker.join();
+    auto end = std::chrono::steady_clock::now();
+
+    BenchResult result;
+    result.name = name;
+    result.threads = threads;
+    result.ops = totalOps;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.allocations = allocationCount.load() - allocationsBefore;
+    return result;
+}
+
+static ChatPacket makePacket(uint16_t groupID) {
+    ChatPacket packet;
+    packet.type = MSG_TEXT;
+    packet.groupID = groupID;
+    packet.payloadSize = 16;
+    memcpy(packet.payload, "benchmark-payload", 16);
+    return packet;
+}
+
+// --- LRUCache --------------------------------------------------------------
+
+static void benchCache(const BenchOptions& options) {
+    const size_t capacity = 10000;
+    const uint16_t groups = 64;
+
+    for (size_t threads : options.threadCounts) {
+        uint64_t ops = options.opsPerThread * threads;
+
+        {
+            LRUCache cache(capacity);
+            std::atomic<uint32_t> sequence(1);
+            report(options, runThreads("cache.put", threads, ops, [&](size_t t) {
+                for (size_t i = 0; i < options.opsPerThread; ++i) {
+                    cache.put(makePacket(static_cast<uint16_t>((t * 131 + i) % groups + 1)),
+                              sequence.fetch_add(1, std::memory_order_relaxed));
+                }
+            }));
+        }
+
+        // Keys 1..capacity are resident; a miss asks for a key never inserted
+        for (int hitPercent : {100, 90, 50}) {
+            LRUCache cache(capacity);
+            for (uint32_t seq = 1; seq <= capacity; ++seq) {
+                cache.put(makePacket(1), seq);
+            }
+            std::string name = "cache.get hit=" + std::to_string(hitPercent) + "%";
+            report(options, runThreads(name, threads, ops, [&](size_t t) {
+                std::mt19937 rng(static_cast<unsigned>(t + 1));
+                ChatPacket out;
+                for (size_t i = 0; i < options.opsPerThread; ++i) {
+                    uint32_t seq = static_cast<uint32_t>(rng() % capacity) + 1;
+                    if (static_cast<int>(rng() % 100) >= hitPercent) seq += capacity;
+                    cache.get(1, seq, out);
+                }
+            }));
+        }
+
+        {
+            LRUCache cache(capacity);
+            for (uint32_t seq = 1; seq <= capacity; ++seq) {
+                cache.put(makePacket(static_cast<uint16_t>(seq % groups + 1)), seq);
+            }
+            uint64_t historyOps = std::max<uint64_t>(1, options.opsPerThread / 100);
+            report(options, runThreads("cache.getGroupHistory", threads, historyOps * threads,
+                                       [&](size_t t) {
+                for (uint64_t i = 0; i < historyOps; ++i) {
+                    cache.getGroupHistory(static_cast<uint16_t>((t + i) % groups + 1), 10);
+                }
+            }));
+        }
+    }
+}
+
+// --- GroupManager ----------------------------------------------------------
+
+static void benchGroups(const BenchOptions& options) {
+    const uint16_t groupCount = 32;
+
+    for (size_t threads : options.threadCounts) {
+        uint64_t ops = options.opsPerThread * threads;
+
+        {
+            GroupManager manager;
+            for (uint16_t g = 1; g < groupCount; ++g) manager.createGroup("bench");
+            report(options, runThreads("groups.join+leave", threads, ops, [&](size_t t) {
+                for (size_t i = 0; i < options.opsPerThread; ++i) {
+                    uint32_t client = static_cast<uint32_t>(t * 1000 + (i / 2) % 1000 + 1);
+                    uint16_t group = static_cast<uint16_t>((i / 2) % groupCount + 1);
+                    if (i & 1) {
+                        manager.leaveGroup(client, group);
+                    } else {
+                        manager.joinGroup(client, group);
+                    }
+                }
+            }));
+        }
+
+        // Readers fan out while one thread in four churns membership
+        {
+            GroupManager manager;
+            for (uint16_t g = 1; g < groupCount; ++g) manager.createGroup("bench");
+            for (uint32_t client = 1; client <= 2000; ++client) {
+                manager.joinGroup(client, static_cast<uint16_t>(client % groupCount + 1));
+            }
+            report(options, runThreads("groups.getGroupMembers+churn", threads, ops, [&](size_t t) {
+                bool churner = (t % 4 == 3);
+                for (size_t i = 0; i < options.opsPerThread; ++i) {
+                    uint16_t group = static_cast<uint16_t>(i % groupCount + 1);
+                    if (churner) {
+                        uint32_t client = static_cast<uint32_t>(5000 + t * 100 + (i / 2) % 100);
+                        uint16_t churnGroup = static_cast<uint16_t>((i / 2) % groupCount + 1);
+                        if (i & 1) {
+                            manager.leaveGroup(client, churnGroup);
+                        } else {
+                            manager.joinGroup(client, churnGroup);
+                        }
+                    } else {
+                        volatile size_t size = manager.getGroupMembers(group).size();
+                        (void)size;
+                    }
+                }
+            }));
+        }
+
+        // Same mix, reading the published snapshot in place
+        {
+            GroupManager manager;
+            for (uint16_t g = 1; g < groupCount; ++g) manager.createGroup("bench");
+            for (uint32_t client = 1; client <= 2000; ++client) {
+                manager.joinGroup(client, static_cast<uint16_t>(client % groupCount + 1));
+            }
+            report(options, runThreads("groups.withGroupMembers+churn", threads, ops, [&](size_t t) {
+                bool churner = (t % 4 == 3);
+                for (size_t i = 0; i < options.opsPerThread; ++i) {
+                    uint16_t group = static_cast<uint16_t>(i % groupCount + 1);
+                    if (churner) {
+                        uint32_t client = static_cast<uint32_t>(5000 + t * 100 + (i / 2) % 100);
+                        uint16_t churnGroup = static_cast<uint16_t>((i / 2) % groupCount + 1);
+                        if (i & 1) {
+                            manager.leaveGroup(client, churnGroup);
+                        } else {
+                            manager.joinGroup(client, churnGroup);
+                        }
+                    } else {
+                        manager.withGroupMembers(group, [](const std::vector<uint32_t>& members) {
+                            volatile size_t size = members.size();
+                            (void)size;
+                        });
+                    }
+                }
+            }));
+        }
+    }
+}
+
+// --- Frames ----------------------------------------------------------------
+
+static void benchFrames(const BenchOptions& options) {
+    const size_t batch = 64;
+
+    for (size_t threads : options.threadCounts) {
+        uint64_t ops = options.opsPerThread * threads;
+        for (WireVersion version : {WIRE_LEGACY, WIRE_V2}) {
+            // Frames live briefly in a batch, like a send queue between flushes
+            report(options, runThreads(version == WIRE_V2 ? "frame.encode v2" : "frame.encode legacy",
+                                       threads, ops, [&](size_t t) {
+                std::vector<FramePtr> held;
+                held.reserve(batch);
+                ChatPacket packet = makePacket(static_cast<uint16_t>(t + 1));
+                for (size_t i = 0; i < options.opsPerThread; ++i) {
+                    held.push_back(encodeFrame(packet, version));
+                    if (held.size() == batch) held.clear();
+                }
+            }));
+        }
+    }
+}
+
+// --- ContentFilter ---------------------------------------------------------
+
+static void benchFilter(const BenchOptions& options) {
+    // 512 keywords that never occur, so every check scans the whole text
+    ContentFilter filter;
+    for (int i = 0; i < 512; ++i) {
+        filter.addPattern("spam-keyword-" + std::to_string(i));
+    }
+
+    const char* texts[][2] = {
+        {"ascii", "Meeting moved to 3pm tomorrow, bring the quarterly numbers and the draft "
+                  "slides for the review; ping me if the room changes again. Thanks!"},
+        {"utf8", "Réunion déplacée à 15h demain — apportez les chiffres trimestriels et "
+                 "le brouillon des diapositives. 会议改到明天下午三点，谢谢！"},
+    };
+    const FilterKernel kernels[] = {KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2};
+
+    for (size_t threads : options.threadCounts) {
+        uint64_t ops = options.opsPerThread * threads;
+        for (const auto& text : texts) {
+            for (FilterKernel kernel : kernels) {
+                if (filter.setKernel(kernel) != kernel) continue;
+                ChatPacket packet;
+                packet.type = MSG_TEXT;
+                packet.payloadSize = static_cast<uint16_t>(strlen(text[1]));
+                memcpy(packet.payload, text[1], packet.payloadSize);
+                std::string name = std::string("filter.check ") + text[0] + " " +
+                                   ContentFilter::kernelName(kernel);
+                report(options, runThreads(name, threads, ops, [&](size_t) {
+                    ChatPacket copy = packet;
+                    for (size_t i = 0; i < options.opsPerThread; ++i) {
+                        if (filter.check(copy) != PAYLOAD_OK) abort();
+                    }
+                }));
+            }
+        }
+    }
+}
+
+// --- ThreadPool ------------------------------------------------------------
+
+static void benchPool(const BenchOptions& options) {
+    const std::pair<SchedulingPolicy, const char*> policies[] = {
+        {ROUND_ROBIN, "pool.enqueue rr"},
+        {SHORTEST_JOB_FIRST, "pool.enqueue sjf"},
+        {WORK_STEALING, "pool.enqueue ws"},
+    };
+
+    for (size_t threads : options.threadCounts) {
+        for (const auto& policy : policies) {
+            std::atomic<uint64_t> executed(0);
+            uint64_t ops = options.opsPerThread * threads;
+
+            // `threads` producers feed a pool of the same size; the clock
+            // stops once every task has run
+            ThreadPool* pool = new ThreadPool(threads, policy.first);
+            BenchResult result = runThreads(policy.second, threads, ops, [&](size_t t) {
+                for (size_t i = 0; i < options.opsPerThread; ++i) {
+                    pool->enqueue([&executed] {
+                        executed.fetch_add(1, std::memory_order_relaxed);
+                    }, static_cast<uint32_t>((t + i) % 16), static_cast<uint32_t>(i));
+                }
+            });
+            auto drainStart = std::chrono::steady_clock::now();
+            while (executed.load() < ops) std::this_thread::yield();
+            result.seconds += std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - drainStart).count();
+            delete pool;
+            report(options, result);
+        }
+    }
+}
+
+// --- Logger ----------------------------------------------------------------
+
+static void benchLogger(const BenchOptions& options) {
+    for (size_t threads : options.threadCounts) {
+        uint64_t ops = options.opsPerThread * threads;
+        for (bool async : {false, true}) {
+            Logger logger("/dev/null");
+            if (async) logger.startAsync(1 << 16, 200);
+            std::string message = "Message received for group 7: benchmark payload text";
+            report(options, runThreads(async ? "logger.log async" : "logger.log sync",
+                                       threads, ops, [&](size_t t) {
+                for (size_t i = 0; i < options.opsPerThread; ++i) {
+                    logger.log(message, static_cast<uint32_t>(t + 1), "127.0.0.1");
+                }
+            }));
+            logger.stopAsync();
+        }
+    }
+}
+
+static bool parseArgs(int argc, char* argv[], BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+
+        if (name == "--threads") {
+            options.threadCounts.clear();
+            std::stringstream list(value);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                size_t count = strtoul(item.c_str(), nullptr, 10);
+                if (count == 0) return false;
+                options.threadCounts.push_back(count);
+            }
+        } else if (name == "--ops") {
+            options.opsPerThread = strtoul(value.c_str(), nullptr, 10);
+            if (options.opsPerThread == 0) return false;
+        } else if (name == "--filter") {
+            options.filter = value;
+        } else if (name == "--format") {
+            options.json = (value == "json");
+        } else {
+            return false;
+        }
+    }
+    return !options.threadCounts.empty();
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--filter=cache|frames|filter|groups|pool|logger] [--threads=1,2,4,8]"
+                  << " [--ops=N] [--format=text|json]" << std::endl;
+        return 1;
+    }
+
+    const std::pair<const char*, void (*)(const BenchOptions&)> suites[] = {
+        {"cache", benchCache},
+        {"frames", benchFrames},
+        {"filter", benchFilter},
+        {"groups", benchGroups},
+        {"pool", benchPool},
+        {"logger", benchLogger},
+    };
+    for (const auto& suite : suites) {
+        if (options.filter.empty() || options.filter == suite.first) {
+            suite.second(options);
+        }
+    }
+    return 0;
+}
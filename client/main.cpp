@@ -3,74 +3,423 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <cstdio>
 #include <cstring>
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <thread>
+#include <vector>
+#include <set>
+#include <stdexcept>
 #include "../shared/protocol.h"
+#include "../shared/frame.h"
 #include "../shared/utils.h"
 
 int sock = 0;
 bool running = true;
+WireVersion wireVersion = WIRE_LEGACY;
 Logger clientLogger("../logs/client_log.txt");
+struct sockaddr_in serverAddress;
 
+// Held while sending, and while the receive thread replaces the socket
+std::mutex socketMutex;
+
+// Session resumption (v3 servers): the session token and the newest
+// sequence number seen in each group, presented again after a reconnect
+const int RECONNECT_ATTEMPTS = 5;
+std::mutex sessionMutex;
+std::string sessionToken(SESSION_TOKEN_SIZE, '\0');
+std::map<uint16_t, uint32_t> lastSeen;
+
+// Media shared in our groups, by ID, for /fetch; and uploads offered but
+// not yet ticketed, by name
+struct KnownMedia {
+    MediaDescriptor descriptor;
+    uint8_t kind;
+    std::string name;
+};
+std::mutex mediaMutex;
+std::map<uint32_t, KnownMedia> knownMedia;
+std::map<std::string, std::string> pendingUploads;
+
+void uploadMedia(std::string path, MediaDescriptor media);
+
+// Live messages already covered by a replay are dropped
+bool recordSequence(const ChatPacket& packet, uint32_t sequence) {
+    if (sequence == 0) return true;
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    uint32_t& seen = lastSeen[packet.groupID];
+    if (sequence <= seen) return packet.type != MSG_TEXT;
+    seen = sequence;
+    return true;
+}
+
+void printPacket(const ChatPacket& packet, uint32_t sequence) {
+    std::string tag = sequence ? " #" + std::to_string(sequence) : "";
+    switch (packet.type) {
+        case MSG_TEXT:
+            std::cout << "\n[Group " << packet.groupID << "] "
+                     << "[User " << packet.senderID << "]" << tag << " "
+                     << formatTimestamp(packet.timestamp) << ": "
+                     << packet.payload << std::endl;
+            break;
+        
+        case MSG_AUDIO:
+        case MSG_VIDEO: {
+            MediaDescriptor media;
+            std::string name;
+            if (!readMediaDescriptor(packet, media, name)) break;
+            const char* kind = (packet.type == MSG_AUDIO) ? "audio" : "video";
+            std::lock_guard<std::mutex> lock(mediaMutex);
+            if (packet.senderID == 0) {
+                // Ticket for an upload we offered
+                auto it = pendingUploads.find(name);
+                if (it == pendingUploads.end()) break;
+                std::cout << "\n[Media]: Uploading " << kind << " '" << name << "' as #"
+                          << media.mediaID << std::endl;
+                std::thread(uploadMedia, it->second, media).detach();
+                pendingUploads.erase(it);
+                break;
+            }
+            KnownMedia& known = knownMedia[media.mediaID];
+            known.descriptor = media;
+            known.kind = packet.type;
+            known.name = name;
+            std::cout << "\n[Group " << packet.groupID << "] "
+                     << "[User " << packet.senderID << "]" << tag << " "
+                     << formatTimestamp(packet.timestamp) << ": shared " << kind << " '" << name
+                     << "' (" << media.size << " bytes), /fetch " << media.mediaID << std::endl;
+            break;
+        }
+        
+        case MSG_RESUME: {
+            ResumeReply reply;
+            if (!readResumeReply(packet, reply)) break;
+            {
+                std::lock_guard<std::mutex> lock(sessionMutex);
+                sessionToken.assign(reinterpret_cast<const char*>(reply.token), SESSION_TOKEN_SIZE);
+                if (reply.status != RESUME_RESTORED) lastSeen.clear();
+            }
+            if (reply.status == RESUME_RESTORED) {
+                std::cout << "\n[Server]: Session resumed, rejoined " << reply.groups
+                          << " group(s)" << std::endl;
+            } else if (reply.status == RESUME_EXPIRED) {
+                std::cout << "\n[Server]: Session expired; use /join to rejoin your groups" << std::endl;
+            }
+            break;
+        }
+        
+        case MSG_ACK:
+            std::cout << "\n[Server]: " << packet.payload << std::endl;
+            break;
+        
+        case MSG_ERROR:
+            std::cout << "\n[Error]: " << packet.payload << std::endl;
+            break;
+        
+        case MSG_STATS:
+            // Chunks end on line boundaries; the empty final chunk prints nothing
+            std::cout << packet.payload << std::flush;
+            break;
+        
+        case MSG_HISTORY: {
+            HistoryPage page;
+            if (packet.senderID == 0 && readHistoryPage(packet, page)) {
+                std::cout << "[History] " << page.count << " message(s)";
+                if (page.count > 0) {
+                    std::cout << ", seq " << page.firstSequence << "-" << page.lastSequence;
+                }
+                std::cout << (page.more ? ", more available" : "") << std::endl;
+                break;
+            }
+            std::cout << "\n[History] [Group " << packet.groupID << "] "
+                     << "[User " << packet.senderID << "]" << tag << " "
+                     << formatTimestamp(packet.timestamp) << ": "
+                     << packet.payload << std::endl;
+            break;
+        }
+        
+        default:
+            break;
+    }
+}
+
+bool reconnect();
+
+// TCP may split or merge frames, so keep a reassembly buffer and decode
+// every complete frame it holds after each read
 void receiveMessages() {
-    char buffer[sizeof(ChatPacket)];
+    std::vector<char> buffer;
+    char chunk[4096];
     
     while (running) {
-        memset(buffer, 0, sizeof(buffer));
-        ssize_t bytesRead = recv(sock, buffer, sizeof(ChatPacket), 0);
+        ssize_t bytesRead = recv(sock, chunk, sizeof(chunk), 0);
         
         if (bytesRead <= 0) {
+            if (running && reconnect()) {
+                buffer.clear();
+                continue;
+            }
             std::cout << "\nDisconnected from server" << std::endl;
             running = false;
             break;
         }
+        buffer.insert(buffer.end(), chunk, chunk + bytesRead);
         
-        ChatPacket packet;
-        memcpy(&packet, buffer, sizeof(ChatPacket));
-        packet.toHostOrder();
-        
-        switch (packet.type) {
-            case MSG_TEXT:
-                std::cout << "\n[Group " << packet.groupID << "] "
-                         << "[User " << packet.senderID << "] "
-                         << formatTimestamp(packet.timestamp) << ": "
-                         << packet.payload << std::endl;
-                break;
-            
-            case MSG_ACK:
-                std::cout << "\n[Server]: " << packet.payload << std::endl;
-                break;
-            
-            case MSG_ERROR:
-                std::cout << "\n[Error]: " << packet.payload << std::endl;
-                break;
-            
-            case MSG_HISTORY:
-                std::cout << "\n[History] [User " << packet.senderID << "] "
-                         << formatTimestamp(packet.timestamp) << ": "
-                         << packet.payload << std::endl;
-                break;
-            
-            default:
-                break;
+        size_t offset = 0;
+        while (offset < buffer.size()) {
+            ChatPacket packet;
+            uint32_t sequence;
+            long consumed = decodeFrame(buffer.data() + offset, buffer.size() - offset,
+                                        wireVersion, packet, &sequence);
+            if (consumed == 0) break;
+            if (consumed < 0) {
+                std::cout << "\nMalformed frame from server" << std::endl;
+                running = false;
+                return;
+            }
+            offset += consumed;
+            if (recordSequence(packet, sequence)) {
+                printPacket(packet, sequence);
+            }
         }
+        buffer.erase(buffer.begin(), buffer.begin() + offset);
         
         std::cout << "> " << std::flush;
     }
 }
 
+bool sendAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+bool recvAll(int fd, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t received = recv(fd, data, length, 0);
+        if (received <= 0) return false;
+        data += received;
+        length -= received;
+    }
+    return true;
+}
+
 void sendPacket(const ChatPacket& packet) {
-    ChatPacket sendPkt = packet;
-    sendPkt.toNetworkOrder();
-    send(sock, &sendPkt, sizeof(ChatPacket), 0);
+    std::lock_guard<std::mutex> lock(socketMutex);
+    Frame frame(packet, wireVersion);
+    sendAll(sock, frame.data(), frame.size());
+}
+
+// Ask for the v3 format. Servers that predate it agree on v2, or answer
+// with an error packet, in which case the connection stays in legacy format.
+// Caller holds socketMutex.
+void negotiateProtocol() {
+    wireVersion = WIRE_LEGACY;
+    ChatPacket hello;
+    hello.type = MSG_HELLO;
+    hello.payload[0] = static_cast<char>(WIRE_V3);
+    hello.payloadSize = 1;
+    Frame frame(hello, WIRE_LEGACY);
+    if (!sendAll(sock, frame.data(), frame.size())) return;
+    
+    char buffer[sizeof(ChatPacket)];
+    if (!recvAll(sock, buffer, sizeof(buffer))) return;
+    
+    ChatPacket reply;
+    decodeFrame(buffer, sizeof(buffer), WIRE_LEGACY, reply);
+    if (reply.type == MSG_HELLO && reply.payloadSize >= 1 &&
+        (reply.payload[0] == WIRE_V2 || reply.payload[0] == WIRE_V3)) {
+        wireVersion = static_cast<WireVersion>(reply.payload[0]);
+    }
+}
+
+// Present the session token (zeros the first time) and the newest
+// sequence seen per group; the reply arrives on the receive thread.
+// Caller holds socketMutex.
+void requestResume() {
+    if (wireVersion != WIRE_V3) return;
+    std::vector<ResumePosition> positions;
+    ChatPacket request;
+    request.type = MSG_RESUME;
+    request.timestamp = getCurrentTimestamp();
+    {
+        std::lock_guard<std::mutex> lock(sessionMutex);
+        for (const auto& seen : lastSeen) {
+            ResumePosition position;
+            position.groupID = seen.first;
+            position.sequence = seen.second;
+            positions.push_back(position);
+        }
+        writeResumeRequest(request, reinterpret_cast<const uint8_t*>(sessionToken.data()),
+                           positions.data(), positions.size());
+    }
+    Frame frame(request, wireVersion);
+    sendAll(sock, frame.data(), frame.size());
+}
+
+// The chat port, or another port on the same server
+int connectToServer(uint16_t port = 0) {
+    struct sockaddr_in address = serverAddress;
+    if (port != 0) address.sin_port = htons(port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Open a media connection and send one request; fills reply on success
+int openMediaTransfer(const MediaDescriptor& media, uint8_t op, uint64_t offset, MediaReply& reply) {
+    int fd = connectToServer(media.port);
+    if (fd < 0) return -1;
+    MediaRequest request;
+    request.op = op;
+    request.mediaID = media.mediaID;
+    request.key = media.key;
+    request.offset = offset;
+    char out[sizeof(MediaRequest)];
+    char in[sizeof(MediaReply)];
+    writeMediaRequest(out, request);
+    if (!sendAll(fd, out, sizeof(out)) || !recvAll(fd, in, sizeof(in))) {
+        close(fd);
+        return -1;
+    }
+    readMediaReply(in, reply);
+    return fd;
+}
+
+// Stream a file to the media port with sendfile, resuming from whatever
+// the server already holds if the connection breaks
+void uploadMedia(std::string path, MediaDescriptor media) {
+    int file = open(path.c_str(), O_RDONLY);
+    for (int attempt = 0; file >= 0 && attempt < RECONNECT_ATTEMPTS && running; ++attempt) {
+        if (attempt > 0) std::this_thread::sleep_for(std::chrono::seconds(1 << (attempt - 1)));
+        MediaReply reply;
+        int fd = openMediaTransfer(media, MEDIA_UPLOAD, 0, reply);
+        if (fd < 0) continue;
+        if (reply.status == MEDIA_BUSY) {
+            close(fd);
+            continue;
+        }
+        if (reply.status != MEDIA_OK) {
+            close(fd);
+            break;
+        }
+        
+        off_t offset = static_cast<off_t>(reply.offset);
+        while (static_cast<uint64_t>(offset) < media.size) {
+            if (sendfile(fd, file, &offset, media.size - offset) <= 0) break;
+        }
+        
+        // The server confirms once every byte is on its disk
+        char in[sizeof(MediaReply)];
+        bool confirmed = reply.offset == media.size ||
+                         (static_cast<uint64_t>(offset) == media.size && recvAll(fd, in, sizeof(in)));
+        close(fd);
+        if (confirmed) {
+            close(file);
+            std::cout << "\n[Media]: Uploaded #" << media.mediaID << " (" << media.size << " bytes)"
+                      << std::endl;
+            clientLogger.log("Uploaded media " + std::to_string(media.mediaID) + " from " + path);
+            return;
+        }
+    }
+    if (file >= 0) close(file);
+    std::cout << "\n[Media]: Upload of " << path << " failed" << std::endl;
+}
+
+// Fetch into path through "<path>.<id>.part", renamed once complete. Only
+// that file is resumed, so an unrelated file at path is never appended to.
+void downloadMedia(MediaDescriptor media, std::string path) {
+    std::string partial = path + "." + std::to_string(media.mediaID) + ".part";
+    int file = open(partial.c_str(), O_WRONLY | O_CREAT, 0644);
+    for (int attempt = 0; file >= 0 && attempt < RECONNECT_ATTEMPTS && running; ++attempt) {
+        if (attempt > 0) std::this_thread::sleep_for(std::chrono::seconds(1 << (attempt - 1)));
+        struct stat info;
+        if (fstat(file, &info) != 0) break;
+        uint64_t offset = static_cast<uint64_t>(info.st_size);
+        if (offset > media.size) {
+            if (ftruncate(file, 0) != 0) break;
+            offset = 0;
+        }
+        
+        MediaReply reply;
+        int fd = (offset == media.size) ? -1 : openMediaTransfer(media, MEDIA_DOWNLOAD, offset, reply);
+        if (fd >= 0 && reply.status != MEDIA_OK) {
+            std::cout << "\n[Media]: #" << media.mediaID << " is not available (status "
+                      << static_cast<int>(reply.status) << ")" << std::endl;
+            close(fd);
+            break;
+        }
+        char buffer[64 * 1024];
+        while (fd >= 0 && offset < media.size) {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0 ||
+                pwrite(file, buffer, received, static_cast<off_t>(offset)) != received) {
+                break;
+            }
+            offset += static_cast<uint64_t>(received);
+        }
+        if (fd >= 0) close(fd);
+        if (offset == media.size) {
+            close(file);
+            if (rename(partial.c_str(), path.c_str()) != 0) {
+                std::cout << "\n[Media]: Cannot move #" << media.mediaID << " from " << partial
+                          << " to " << path << std::endl;
+                return;
+            }
+            std::cout << "\n[Media]: Saved #" << media.mediaID << " to " << path << std::endl;
+            return;
+        }
+    }
+    if (file >= 0) close(file);
+    std::cout << "\n[Media]: Download of #" << media.mediaID << " failed" << std::endl;
+}
+
+// The connection dropped: retry with backoff and resume the session, so
+// the server restores our groups and replays what we missed
+bool reconnect() {
+    std::cout << "\nConnection lost, reconnecting..." << std::endl;
+    for (int attempt = 0; attempt < RECONNECT_ATTEMPTS && running; ++attempt) {
+        std::this_thread::sleep_for(std::chrono::seconds(1 << attempt));
+        int fd = connectToServer();
+        if (fd < 0) continue;
+        
+        std::lock_guard<std::mutex> lock(socketMutex);
+        close(sock);
+        sock = fd;
+        negotiateProtocol();
+        requestResume();
+        clientLogger.log("Reconnected to server");
+        return true;
+    }
+    return false;
 }
 
 void printHelp() {
     std::cout << "\n=== Chat Client Commands ===" << std::endl;
-    std::cout << "/join <group_id>     - Join a group" << std::endl;
+    std::cout << "/join <group_id>     - Join a group and send to it" << std::endl;
+    std::cout << "/use <group_id>      - Send to another joined group" << std::endl;
     std::cout << "/create <group_name> - Create a new group" << std::endl;
     std::cout << "/list                - List all groups" << std::endl;
-    std::cout << "/leave               - Leave current group" << std::endl;
+    std::cout << "/leave [group_id]    - Leave a group (default: current)" << std::endl;
+    std::cout << "/history [before|after <seq>] [limit]" << std::endl;
+    std::cout << "                     - Page through the current group's history" << std::endl;
+    std::cout << "/audio <file>        - Share an audio file with the current group" << std::endl;
+    std::cout << "/video <file>        - Share a video file with the current group" << std::endl;
+    std::cout << "/fetch <media_id> [file] - Download shared media" << std::endl;
+    std::cout << "/stats               - Show server metrics" << std::endl;
     std::cout << "/help                - Show this help" << std::endl;
     std::cout << "/quit                - Quit the client" << std::endl;
     std::cout << "Type any message to send to current group" << std::endl;
@@ -87,31 +436,32 @@ int main(int argc, char* argv[]) {
         port = atoi(argv[2]);
     }
     
-    struct sockaddr_in serv_addr;
-    
-    // Create socket
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        std::cerr << "Socket creation error" << std::endl;
-        return -1;
-    }
-    
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(port);
+    memset(&serverAddress, 0, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(port);
     
     // Convert IPv4 address
-    if (inet_pton(AF_INET, serverIP.c_str(), &serv_addr.sin_addr) <= 0) {
+    if (inet_pton(AF_INET, serverIP.c_str(), &serverAddress.sin_addr) <= 0) {
         std::cerr << "Invalid address" << std::endl;
         return -1;
     }
     
     // Connect
-    if (connect(sock, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0) {
+    if ((sock = connectToServer()) < 0) {
         std::cerr << "Connection failed" << std::endl;
         return -1;
     }
     
+    {
+        std::lock_guard<std::mutex> lock(socketMutex);
+        negotiateProtocol();
+        requestResume();
+    }
+    
     std::cout << "Connected to chat server at " << serverIP << ":" << port << std::endl;
-    clientLogger.log("Connected to server at " + serverIP);
+    clientLogger.log("Connected to server at " + serverIP + 
+                     (wireVersion == WIRE_V3 ? " (protocol v3)" :
+                      wireVersion == WIRE_V2 ? " (protocol v2)" : " (legacy protocol)"));
     
     printHelp();
     
@@ -119,6 +469,8 @@ int main(int argc, char* argv[]) {
     std::thread recvThread(receiveMessages);
     recvThread.detach();
     
+    // Every group joined on this connection; messages go to currentGroup
+    std::set<uint16_t> joinedGroups;
     uint16_t currentGroup = 0;
     
     while (running) {
@@ -138,6 +490,7 @@ int main(int argc, char* argv[]) {
                     uint16_t groupID = std::stoi(input.substr(6));
                     packet.type = MSG_JOIN_GROUP;
                     packet.groupID = groupID;
+                    joinedGroups.insert(groupID);
                     currentGroup = groupID;
                     sendPacket(packet);
                     clientLogger.log("Joining group " + std::to_string(groupID));
@@ -149,7 +502,7 @@ int main(int argc, char* argv[]) {
                 std::string groupName = input.substr(8);
                 packet.type = MSG_CREATE_GROUP;
                 strncpy(packet.payload, groupName.c_str(), sizeof(packet.payload) - 1);
-                packet.payloadSize = groupName.length();
+                packet.payloadSize = strlen(packet.payload);
                 sendPacket(packet);
                 clientLogger.log("Creating group: " + groupName);
             }
@@ -157,11 +510,147 @@ int main(int argc, char* argv[]) {
                 packet.type = MSG_LIST_GROUPS;
                 sendPacket(packet);
             }
-            else if (input == "/leave") {
+            else if (input.find("/use ") == 0) {
+                try {
+                    uint16_t groupID = std::stoi(input.substr(5));
+                    if (joinedGroups.count(groupID)) {
+                        currentGroup = groupID;
+                        std::cout << "Sending to group " << groupID << std::endl;
+                    } else {
+                        std::cout << "Not in group " << groupID << ". Use /join first." << std::endl;
+                    }
+                } catch (...) {
+                    std::cout << "Usage: /use <group_id>" << std::endl;
+                }
+            }
+            else if (input == "/leave" || input.find("/leave ") == 0) {
+                uint16_t groupID = currentGroup;
+                try {
+                    if (input.size() > 7) groupID = std::stoi(input.substr(7));
+                } catch (...) {
+                    std::cout << "Usage: /leave [group_id]" << std::endl;
+                    continue;
+                }
+                if (groupID == 0) {
+                    std::cout << "You are not in a group" << std::endl;
+                    continue;
+                }
                 packet.type = MSG_LEAVE_GROUP;
+                packet.groupID = groupID;
+                sendPacket(packet);
+                joinedGroups.erase(groupID);
+                {
+                    std::lock_guard<std::mutex> lock(sessionMutex);
+                    lastSeen.erase(groupID);
+                }
+                if (currentGroup == groupID) {
+                    currentGroup = joinedGroups.empty() ? 0 : *joinedGroups.begin();
+                }
+                clientLogger.log("Leaving group " + std::to_string(groupID));
+            }
+            else if (input == "/history" || input.find("/history ") == 0) {
+                if (currentGroup == 0) {
+                    std::cout << "You must join a group first. Use /join <group_id>" << std::endl;
+                    continue;
+                }
+                
+                // /history [limit] | /history before|after <seq> [limit]
+                HistoryCursor cursor;
+                cursor.direction = HISTORY_BEFORE;
+                cursor.sequence = 0;
+                cursor.limit = 10;
+                std::vector<std::string> args;
+                size_t pos = 8;
+                while (pos < input.size()) {
+                    size_t start = input.find_first_not_of(' ', pos);
+                    if (start == std::string::npos) break;
+                    size_t end = input.find(' ', start);
+                    if (end == std::string::npos) end = input.size();
+                    args.push_back(input.substr(start, end - start));
+                    pos = end;
+                }
+                try {
+                    size_t next = 0;
+                    if (!args.empty() && (args[0] == "before" || args[0] == "after")) {
+                        if (args.size() < 2) throw std::invalid_argument("sequence");
+                        cursor.direction = (args[0] == "after") ? HISTORY_AFTER : HISTORY_BEFORE;
+                        cursor.sequence = static_cast<uint32_t>(std::stoul(args[1]));
+                        next = 2;
+                    }
+                    if (next < args.size()) {
+                        cursor.limit = static_cast<uint16_t>(std::stoi(args[next]));
+                    }
+                } catch (...) {
+                    std::cout << "Usage: /history [before|after <seq>] [limit]" << std::endl;
+                    continue;
+                }
+                
+                packet.type = MSG_HISTORY;
+                packet.groupID = currentGroup;
+                writeHistoryCursor(packet, cursor);
+                sendPacket(packet);
+            }
+            else if (input.find("/audio ") == 0 || input.find("/video ") == 0) {
+                if (currentGroup == 0) {
+                    std::cout << "You must join a group first. Use /join <group_id>" << std::endl;
+                    continue;
+                }
+                std::string path = input.substr(7);
+                struct stat info;
+                if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+                    std::cout << "Cannot read " << path << std::endl;
+                    continue;
+                }
+                std::string name = path.substr(path.rfind('/') + 1);
+                {
+                    std::lock_guard<std::mutex> lock(mediaMutex);
+                    pendingUploads[name] = path;
+                }
+                MediaDescriptor offer;
+                offer.mediaID = 0;
+                offer.key = 0;
+                offer.size = static_cast<uint64_t>(info.st_size);
+                offer.port = 0;
+                packet.type = (input[1] == 'a') ? MSG_AUDIO : MSG_VIDEO;
+                packet.groupID = currentGroup;
+                writeMediaDescriptor(packet, offer, name);
+                sendPacket(packet);
+            }
+            else if (input.find("/fetch ") == 0) {
+                std::string path;
+                uint32_t mediaID;
+                try {
+                    size_t end;
+                    mediaID = static_cast<uint32_t>(std::stoul(input.substr(7), &end));
+                    size_t start = input.find_first_not_of(' ', 7 + end);
+                    if (start != std::string::npos) path = input.substr(start);
+                } catch (...) {
+                    std::cout << "Usage: /fetch <media_id> [file]" << std::endl;
+                    continue;
+                }
+                KnownMedia known;
+                {
+                    std::lock_guard<std::mutex> lock(mediaMutex);
+                    auto it = knownMedia.find(mediaID);
+                    if (it == knownMedia.end()) {
+                        std::cout << "No media #" << mediaID << " seen in your groups" << std::endl;
+                        continue;
+                    }
+                    known = it->second;
+                }
+                if (path.empty()) {
+                    // Names come from other users: keep them inside this directory
+                    std::string name = known.name;
+                    for (char& c : name) {
+                        if (c == '/') c = '_';
+                    }
+                    path = "media_" + std::to_string(mediaID) + "_" + name;
+                }
+                std::thread(downloadMedia, known.descriptor, path).detach();
+            }
+            else if (input == "/stats") {
+                packet.type = MSG_STATS;
                 sendPacket(packet);
-                currentGroup = 0;
-                clientLogger.log("Leaving group");
             }
             else if (input == "/help") {
                 printHelp();
@@ -185,7 +674,7 @@ int main(int argc, char* argv[]) {
             packet.type = MSG_TEXT;
             packet.groupID = currentGroup;
             strncpy(packet.payload, input.c_str(), sizeof(packet.payload) - 1);
-            packet.payloadSize = input.length();
+            packet.payloadSize = strlen(packet.payload);
             sendPacket(packet);
             
             clientLogger.log("Sent message to group " + std::to_string(currentGroup) + 
@@ -0,0 +1,44 @@
+#ifndef CONNECTION_REGISTRY_H
+#define CONNECTION_REGISTRY_H
+
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include "reactor.cpp"
+
+// Maps client IDs to live connections across every reactor. Fan-out does
+// not come here (each reactor resolves its own members); this serves
+// lookups from any thread. Lookups vastly outnumber connects/disconnects,
+// hence the shared lock.
+class ConnectionRegistry {
+private:
+    std::unordered_map<uint32_t, std::shared_ptr<Connection>> connections;
+    mutable std::shared_mutex registryMutex;
+    
+public:
+    void add(const std::shared_ptr<Connection>& conn) {
+        std::unique_lock<std::shared_mutex> lock(registryMutex);
+        connections[conn->clientID] = conn;
+    }
+    
+    void remove(uint32_t clientID) {
+        std::unique_lock<std::shared_mutex> lock(registryMutex);
+        connections.erase(clientID);
+    }
+    
+    std::shared_ptr<Connection> find(uint32_t clientID) const {
+        std::shared_lock<std::shared_mutex> lock(registryMutex);
+        auto it = connections.find(clientID);
+        if (it != connections.end()) {
+            return it->second;
+        }
+        return nullptr;
+    }
+    
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(registryMutex);
+        return connections.size();
+    }
+};
+
+#endif // CONNECTION_REGISTRY_H
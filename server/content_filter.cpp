@@ -0,0 +1,332 @@
+#ifndef CONTENT_FILTER_H
+#define CONTENT_FILTER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "../shared/protocol.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define CONTENT_FILTER_X86 1
+#endif
+
+// Instruction set used by the scanning kernels
+enum FilterKernel {
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2
+};
+
+enum PayloadVerdict {
+    PAYLOAD_OK,
+    PAYLOAD_OVERSIZED,  // payloadSize larger than the payload buffer
+    PAYLOAD_MALFORMED,  // text that is not NUL-free UTF-8
+    PAYLOAD_BLOCKED     // text containing a filtered keyword
+};
+
+inline const char* verdictMessage(PayloadVerdict verdict) {
+    switch (verdict) {
+        case PAYLOAD_OVERSIZED: return "Payload exceeds 256 bytes";
+        case PAYLOAD_MALFORMED: return "Payload is not valid UTF-8 text";
+        case PAYLOAD_BLOCKED:   return "Message blocked by content filter";
+        default:                return "OK";
+    }
+}
+
+// Validation and moderation stage between decode and routing. Every packet
+// has its payloadSize checked against the buffer; text payloads (messages
+// and group names) must be NUL-free UTF-8, are NUL-terminated in place, and
+// are matched case-insensitively (ASCII) against the keyword list.
+//
+// Validation works on 16 (SSE2) or 32 (AVX2) bytes per step, skipping ASCII
+// runs with one compare per block and decoding only multibyte sequences
+// byte by byte. Matching runs every keyword at once: the list is compiled
+// into one Aho-Corasick automaton, so a check is one table step per byte
+// however many keywords there are. Patterns are fixed after startup, so
+// checks take no locks.
+class ContentFilter {
+private:
+    static const size_t MAX_PATTERN_LENGTH = 64;
+    static const uint32_t MATCH_FLAG = 0x80000000u;
+
+    std::vector<std::string> patterns;  // lowercase
+    FilterKernel kernel;
+
+    // The automaton as a DFA over byte classes: bytes in no keyword share
+    // class 0, and A-Z share the class of their lowercase letter, so case
+    // is folded by the lookup. next[row + class] is the following state's
+    // row (state * classCount), with MATCH_FLAG set when a keyword ends
+    // there. Rebuilt by compile() whenever the list changes.
+    uint8_t byteClass[256];
+    size_t classCount;
+    std::vector<uint32_t> next;
+
+    static bool cpuSupports(FilterKernel wanted) {
+#ifdef CONTENT_FILTER_X86
+        __builtin_cpu_init();  // may run before the runtime's own constructors
+        if (wanted == KERNEL_AVX2) return __builtin_cpu_supports("avx2");
+        return true;
+#else
+        return wanted == KERNEL_SCALAR;
+#endif
+    }
+
+    static bool isTextType(uint8_t type) {
+        return type == MSG_TEXT || type == MSG_CREATE_GROUP;
+    }
+
+    // Length of one well-formed multibyte UTF-8 sequence at data, or 0
+    // (RFC 3629: no overlongs, surrogates or code points past U+10FFFF)
+    static size_t utf8Sequence(const unsigned char* data, size_t available) {
+        unsigned char lead = data[0];
+        size_t length;
+        unsigned char low = 0x80, high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;
+            if (lead == 0xED) high = 0x9F;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;
+            if (lead == 0xF4) high = 0x8F;
+        } else {
+            return 0;
+        }
+        if (available < length) return 0;
+        if (data[1] < low || data[1] > high) return 0;
+        for (size_t i = 2; i < length; ++i) {
+            if ((data[i] & 0xC0) != 0x80) return 0;
+        }
+        return length;
+    }
+
+    // Bytes from the start that are plain ASCII (0x01-0x7F)
+    static size_t asciiRunScalar(const unsigned char* data, size_t length) {
+        size_t i = 0;
+        while (i < length && data[i] != 0 && data[i] < 0x80) ++i;
+        return i;
+    }
+
+#ifdef CONTENT_FILTER_X86
+    static size_t asciiRunSse2(const unsigned char* data, size_t length) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            unsigned stop = static_cast<unsigned>(
+                _mm_movemask_epi8(block) | _mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)));
+            if (stop) return i + __builtin_ctz(stop);
+        }
+        return i + asciiRunScalar(data + i, length - i);
+    }
+
+    __attribute__((target("avx2")))
+    static size_t asciiRunAvx2(const unsigned char* data, size_t length) {
+        const __m256i zero = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            unsigned stop = static_cast<unsigned>(
+                _mm256_movemask_epi8(block) | _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero)));
+            if (stop) return i + __builtin_ctz(stop);
+        }
+        return i + asciiRunSse2(data + i, length - i);
+    }
+#endif
+
+    size_t asciiRun(const unsigned char* data, size_t length) const {
+#ifdef CONTENT_FILTER_X86
+        if (kernel == KERNEL_AVX2) return asciiRunAvx2(data, length);
+        if (kernel == KERNEL_SSE2) return asciiRunSse2(data, length);
+#endif
+        return asciiRunScalar(data, length);
+    }
+
+    // Keep a keyword; matching sees it after the next compile()
+    bool insertPattern(const std::string& pattern) {
+        if (pattern.empty()) return true;
+        if (pattern.size() > MAX_PATTERN_LENGTH || pattern.find('\0') != std::string::npos ||
+            patterns.size() >= MAX_PATTERNS) {
+            return false;
+        }
+        std::string folded(pattern);
+        for (char& c : folded) {
+            if (c >= 'A' && c <= 'Z') c = static_cast<char>(c | 0x20);
+        }
+        patterns.push_back(folded);
+        return true;
+    }
+
+    // Build the trie of all keywords, then fill in every missing edge from
+    // the failure links in breadth-first order, so the scan never backs up
+    void compile() {
+        memset(byteClass, 0, sizeof(byteClass));
+        classCount = 1;
+        for (const std::string& pattern : patterns) {
+            for (char c : pattern) {
+                uint8_t byte = static_cast<uint8_t>(c);
+                if (byteClass[byte] == 0) byteClass[byte] = static_cast<uint8_t>(classCount++);
+            }
+        }
+        for (int c = 'A'; c <= 'Z'; ++c) {
+            byteClass[c] = byteClass[c | 0x20];
+        }
+
+        // Edges to 0 are missing: the root is never a trie edge's target
+        next.assign(classCount, 0);
+        std::vector<bool> terminal(1, false);
+        for (const std::string& pattern : patterns) {
+            uint32_t state = 0;
+            for (char c : pattern) {
+                size_t slot = state * classCount + byteClass[static_cast<uint8_t>(c)];
+                if (next[slot] == 0) {
+                    next[slot] = static_cast<uint32_t>(terminal.size());
+                    terminal.push_back(false);
+                    next.resize(next.size() + classCount, 0);
+                }
+                state = next[slot];
+            }
+            terminal[state] = true;
+        }
+
+        std::vector<uint32_t> fail(terminal.size(), 0);
+        std::vector<uint32_t> order;
+        for (size_t c = 0; c < classCount; ++c) {
+            if (next[c] != 0) order.push_back(next[c]);
+        }
+        for (size_t head = 0; head < order.size(); ++head) {
+            uint32_t state = order[head];
+            if (terminal[fail[state]]) terminal[state] = true;
+            for (size_t c = 0; c < classCount; ++c) {
+                uint32_t& edge = next[state * classCount + c];
+                uint32_t fallback = next[fail[state] * classCount + c];
+                if (edge != 0) {
+                    fail[edge] = fallback;
+                    order.push_back(edge);
+                } else {
+                    edge = fallback;
+                }
+            }
+        }
+
+        for (uint32_t& edge : next) {
+            edge = static_cast<uint32_t>(edge * classCount) | (terminal[edge] ? MATCH_FLAG : 0);
+        }
+    }
+
+public:
+    // Keywords a filter accepts. The table grows with total keyword bytes
+    // times distinct bytes used; at this cap, plain-text keywords stay
+    // within tens of megabytes.
+    static const size_t MAX_PATTERNS = 4096;
+
+    ContentFilter() : kernel(KERNEL_SCALAR), classCount(1), next(1, 0) {
+        memset(byteClass, 0, sizeof(byteClass));
+        setKernel(KERNEL_AVX2);
+    }
+
+    // Use the given kernel, or the best one below it the CPU supports
+    FilterKernel setKernel(FilterKernel wanted) {
+        while (wanted != KERNEL_SCALAR && !cpuSupports(wanted)) {
+            wanted = static_cast<FilterKernel>(wanted - 1);
+        }
+        kernel = wanted;
+        return kernel;
+    }
+
+    FilterKernel getKernel() const {
+        return kernel;
+    }
+
+    static const char* kernelName(FilterKernel kernel) {
+        switch (kernel) {
+            case KERNEL_AVX2: return "avx2";
+            case KERNEL_SSE2: return "sse2";
+            default:          return "scalar";
+        }
+    }
+
+    // Keywords are matched case-insensitively; empty ones are ignored.
+    // Fails for a keyword over 64 bytes or containing NUL, or past
+    // MAX_PATTERNS. Recompiles the automaton; load lists with loadPatterns.
+    bool addPattern(const std::string& pattern) {
+        if (!insertPattern(pattern)) return false;
+        compile();
+        return true;
+    }
+
+    // One keyword per line; blank lines and lines starting with # are
+    // skipped. Returns false with the offending line number on error.
+    bool loadPatterns(const std::string& path, size_t& badLine) {
+        std::ifstream file(path);
+        badLine = 0;
+        if (!file) return false;
+        std::string line;
+        size_t number = 0;
+        while (std::getline(file, line)) {
+            ++number;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            if (!insertPattern(line)) {
+                badLine = number;
+                compile();
+                return false;
+            }
+        }
+        compile();
+        return true;
+    }
+
+    size_t patternCount() const {
+        return patterns.size();
+    }
+
+    bool isValidText(const char* text, size_t length) const {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text);
+        size_t i = 0;
+        while (i < length) {
+            i += asciiRun(data + i, length - i);
+            // Decode multibyte sequences until the next ASCII byte
+            while (i < length && data[i] >= 0x80) {
+                size_t sequence = utf8Sequence(data + i, length - i);
+                if (sequence == 0) return false;
+                i += sequence;
+            }
+            if (i < length && data[i] == 0) return false;
+        }
+        return true;
+    }
+
+    bool matches(const char* text, size_t length) const {
+        if (patterns.empty()) return false;
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(text);
+        const uint32_t* table = next.data();
+        uint32_t row = 0;
+        for (size_t i = 0; i < length; ++i) {
+            row = table[row + byteClass[data[i]]];
+            if (row & MATCH_FLAG) return true;
+        }
+        return false;
+    }
+
+    // Check a decoded packet; accepted text payloads come back
+    // NUL-terminated whenever they leave room for it
+    PayloadVerdict check(ChatPacket& packet) const {
+        if (packet.payloadSize > MAX_PAYLOAD_SIZE) return PAYLOAD_OVERSIZED;
+        if (!isTextType(packet.type)) return PAYLOAD_OK;
+
+        size_t length = packet.payloadSize;
+        if (!isValidText(packet.payload, length)) return PAYLOAD_MALFORMED;
+        if (length < MAX_PAYLOAD_SIZE) packet.payload[length] = '\0';
+        if (matches(packet.payload, length)) return PAYLOAD_BLOCKED;
+        return PAYLOAD_OK;
+    }
+};
+
+#endif // CONTENT_FILTER_H
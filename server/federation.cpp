@@ -0,0 +1,701 @@
+#ifndef FEDERATION_H
+#define FEDERATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../shared/frame.h"
+#include "../shared/history_store.h"
+#include "../shared/metrics.h"
+#include "../shared/protocol.h"
+#include "group_manager.cpp"
+
+// Upper bound for --peers; subscriptions are a 64-bit node mask per group
+static const size_t MAX_NODES = 64;
+
+// An idle link sends a ping this often, so a dead peer is noticed
+static const int LINK_PING_INTERVAL_MS = 1000;
+static const int LINK_RECONNECT_DELAY_MS = 500;
+
+struct PeerAddress {
+    std::string host;
+    int port;
+};
+
+// Node-to-node frames: a LinkHeader in network order followed by `length`
+// bytes. FORWARD, DELIVER and HISTORY_REQUEST carry one v2 packet frame,
+// HISTORY_REPLY consecutive v2 frames, GROUP the group name.
+enum LinkFrameKind {
+    LINK_HELLO = 1,            // value = sending node, body = shared secret; starts every link
+    LINK_PING = 2,             // keeps an idle link checked
+    LINK_GROUP = 3,            // owner announces one of its groups
+    LINK_SUBSCRIBE = 4,        // sender has local members of groupID
+    LINK_UNSUBSCRIBE = 5,      // ... and now has none
+    LINK_FORWARD = 6,          // message for the owner to sequence
+    LINK_DELIVER = 7,          // sequenced message; value = sequence
+    LINK_HISTORY_REQUEST = 8,  // value = requesting client
+    LINK_HISTORY_REPLY = 9     // value = requesting client; body is v3 frames
+};
+
+#pragma pack(push, 1)
+struct LinkHeader {
+    uint8_t kind;
+    uint16_t groupID;
+    uint32_t value;
+    uint32_t length;
+};
+#pragma pack(pop)
+
+// Peering between server instances. Every group has an owning node
+// (groupID modulo the node count, which is also the node that created it):
+// the owner sequences, stores and serves history for the group, and relays
+// each message to the nodes that have told it they have local members.
+// Other nodes forward their clients' messages to the owner and deliver
+// what it relays to their own members, so each node keeps only a local
+// membership view and a replicated table of group names.
+//
+// Each node keeps one persistent outbound link per peer and accepts the
+// peers' links for inbound traffic. The listener is bound to this node's
+// configured host and takes connections only from the configured peer
+// addresses; a link is trusted once its HELLO names a node whose address
+// it comes from and carries the shared secret, if one is set. A link's frames are queued in one
+// buffer and written by its thread in a single send, so everything queued
+// during a write is batched into the next. A link that breaks reconnects
+// and replays this node's state (groups it owns, subscriptions it holds)
+// before anything else queued, starting with the frames of the failed
+// write that never fully reached the kernel.
+class Federation {
+private:
+    static const size_t LINK_BUFFER_LIMIT = 8u << 20;  // bytes queued per peer
+    static const size_t MAX_LINK_FRAME = 1u << 20;
+    static const int SEND_TIMEOUT_SEC = 5;
+
+    struct PeerLink {
+        uint32_t node;
+        PeerAddress address;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::string pending;  // encoded frames not yet written
+        std::atomic<bool> connected;
+        std::thread thread;
+
+        PeerLink(uint32_t index, const PeerAddress& peer)
+            : node(index), address(peer), connected(false) {}
+    };
+
+    uint32_t nodeIndex;
+    uint32_t nodeCount;
+    std::vector<PeerAddress> peers;
+    std::vector<std::vector<in_addr_t>> peerHosts;  // resolved IPv4 addresses, by node
+    std::string secret;
+    GroupManager& groups;
+    std::vector<std::unique_ptr<PeerLink>> links;  // by node; null for this node
+    std::atomic<bool> stopping;
+
+    int listenFd;
+    std::thread acceptThread;
+    std::mutex inboundMutex;
+    std::vector<int> inboundFds;
+    std::vector<std::thread> readerThreads;
+    std::vector<std::thread::id> finishedReaders;  // joined on the next accept
+
+    // Owner side: bit n set while node n has members of the group
+    std::unique_ptr<std::atomic<uint64_t>[]> subscribers;
+
+    // Member side: remote groups this node has subscribed to at their owner
+    std::mutex subscriptionMutex;
+    std::unordered_set<uint16_t> subscribed;
+
+    Counter* forwardedCounter;
+    Counter* relayedCounter;
+    Counter* batchesCounter;
+    Counter* droppedCounter;
+    Counter* rejectedCounter;
+
+    static void appendFrame(std::string& out, uint8_t kind, uint16_t groupID, uint32_t value,
+                            const char* body, size_t length) {
+        LinkHeader header;
+        header.kind = kind;
+        header.groupID = htons(groupID);
+        header.value = htonl(value);
+        header.length = htonl(static_cast<uint32_t>(length));
+        out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (length > 0) out.append(body, length);
+    }
+
+    static void appendPacket(std::string& out, uint8_t kind, uint32_t value, const ChatPacket& packet) {
+        Frame frame(packet, WIRE_V2);
+        appendFrame(out, kind, packet.groupID, value, frame.data(), frame.size());
+    }
+
+    // Queue frames for a peer; dropped (and counted) past the link's limit
+    void enqueue(uint32_t node, const std::string& frames) {
+        PeerLink* link = links[node].get();
+        if (!link) return;
+        bool wasEmpty;
+        {
+            std::lock_guard<std::mutex> lock(link->mutex);
+            if (link->pending.size() + frames.size() > LINK_BUFFER_LIMIT) {
+                if (droppedCounter) droppedCounter->add();
+                return;
+            }
+            wasEmpty = link->pending.empty();
+            link->pending += frames;
+        }
+        if (wasEmpty) link->wake.notify_one();
+    }
+
+    // Bytes handed to the kernel; less than length if the link failed
+    static size_t writeAll(int fd, const char* data, size_t length) {
+        size_t written = 0;
+        while (written < length) {
+            ssize_t sent = send(fd, data + written, length - written, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            written += static_cast<size_t>(sent);
+        }
+        return written;
+    }
+
+    // Start of the first frame in batch not completely within its first
+    // `written` bytes
+    static size_t unsentFrame(const std::string& batch, size_t written) {
+        size_t offset = 0;
+        while (offset + sizeof(LinkHeader) <= batch.size()) {
+            LinkHeader header;
+            memcpy(&header, batch.data() + offset, sizeof(header));
+            size_t end = offset + sizeof(header) + ntohl(header.length);
+            if (end > written) break;
+            offset = end;
+        }
+        return offset;
+    }
+
+    static std::vector<in_addr_t> resolve(const std::string& host) {
+        std::vector<in_addr_t> addresses;
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0) {
+            return addresses;
+        }
+        for (struct addrinfo* entry = result; entry; entry = entry->ai_next) {
+            addresses.push_back(reinterpret_cast<struct sockaddr_in*>(entry->ai_addr)->sin_addr.s_addr);
+        }
+        freeaddrinfo(result);
+        return addresses;
+    }
+
+    bool fromNode(uint32_t node, in_addr_t source) const {
+        const std::vector<in_addr_t>& hosts = peerHosts[node];
+        return std::find(hosts.begin(), hosts.end(), source) != hosts.end();
+    }
+
+    bool fromAnyPeer(in_addr_t source) const {
+        for (uint32_t node = 0; node < nodeCount; ++node) {
+            if (node != nodeIndex && fromNode(node, source)) return true;
+        }
+        return false;
+    }
+
+    // Compares every byte, so the time taken does not reveal the prefix
+    // a guess got right
+    bool secretMatches(const char* body, size_t length) const {
+        if (length != secret.size()) return false;
+        unsigned char difference = 0;
+        for (size_t i = 0; i < length; ++i) {
+            difference |= static_cast<unsigned char>(body[i] ^ secret[i]);
+        }
+        return difference == 0;
+    }
+
+    static int connectTo(const PeerAddress& address) {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        if (getaddrinfo(address.host.c_str(), std::to_string(address.port).c_str(),
+                        &hints, &result) != 0) {
+            return -1;
+        }
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0) {
+            int on = 1;
+            struct timeval timeout = {SEND_TIMEOUT_SEC, 0};
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            if (connect(fd, result->ai_addr, result->ai_addrlen) < 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(result);
+        return fd;
+    }
+
+    // What a peer must know about this node after (re)connecting
+    std::string linkState(uint32_t node) {
+        std::string frames;
+        appendFrame(frames, LINK_HELLO, 0, nodeIndex, secret.data(), secret.size());
+        for (const auto& group : groups.listGroups()) {
+            if (owns(group.first)) {
+                appendFrame(frames, LINK_GROUP, group.first, 0, group.second.data(), group.second.size());
+            }
+        }
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        for (uint16_t groupID : subscribed) {
+            if (ownerOf(groupID) == node) {
+                appendFrame(frames, LINK_SUBSCRIBE, groupID, 0, nullptr, 0);
+            }
+        }
+        return frames;
+    }
+
+    void linkLoop(PeerLink& link) {
+        int fd = -1;
+        std::string batch;
+        while (!stopping.load()) {
+            if (fd < 0) {
+                fd = connectTo(link.address);
+                if (fd < 0) {
+                    std::unique_lock<std::mutex> lock(link.mutex);
+                    link.wake.wait_for(lock, std::chrono::milliseconds(LINK_RECONNECT_DELAY_MS),
+                                       [this] { return stopping.load(); });
+                    continue;
+                }
+                std::string state = linkState(link.node);
+                std::lock_guard<std::mutex> lock(link.mutex);
+                link.pending.insert(0, state);
+                link.connected.store(true);
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(link.mutex);
+                link.wake.wait_for(lock, std::chrono::milliseconds(LINK_PING_INTERVAL_MS),
+                                   [this, &link] { return !link.pending.empty() || stopping.load(); });
+                batch.swap(link.pending);
+            }
+            if (batch.empty()) {
+                appendFrame(batch, LINK_PING, 0, 0, nullptr, 0);
+            }
+            size_t written = writeAll(fd, batch.data(), batch.size());
+            if (written < batch.size()) {
+                // Frames the kernel did not take whole go out again after
+                // the reconnect, behind the replayed state. Frames it took
+                // are not resent, so a broken link may lose (never repeat)
+                // what was still in flight.
+                size_t unsent = unsentFrame(batch, written);
+                {
+                    std::lock_guard<std::mutex> lock(link.mutex);
+                    link.pending.insert(0, batch, unsent, std::string::npos);
+                }
+                close(fd);
+                fd = -1;
+                link.connected.store(false);
+            } else if (batchesCounter) {
+                batchesCounter->add();
+            }
+            batch.clear();
+        }
+        if (fd >= 0) close(fd);
+        link.connected.store(false);
+    }
+
+    void acceptLoop() {
+        while (!stopping.load()) {
+            struct pollfd ready = {listenFd, POLLIN, 0};
+            if (poll(&ready, 1, 200) <= 0) continue;
+            struct sockaddr_in source;
+            socklen_t sourceLength = sizeof(source);
+            int fd = accept(listenFd, reinterpret_cast<struct sockaddr*>(&source), &sourceLength);
+            if (fd < 0) continue;
+            if (!fromAnyPeer(source.sin_addr.s_addr)) {
+                if (rejectedCounter) rejectedCounter->add();
+                close(fd);
+                continue;
+            }
+            in_addr_t from = source.sin_addr.s_addr;
+            std::lock_guard<std::mutex> lock(inboundMutex);
+            if (stopping.load()) {
+                close(fd);
+                break;
+            }
+            reapReaders();
+            inboundFds.push_back(fd);
+            readerThreads.emplace_back([this, fd, from] { readLoop(fd, from); });
+        }
+    }
+
+    // Join readers whose peer disconnected. Caller holds inboundMutex; a
+    // finished reader only has to return once it has released it.
+    void reapReaders() {
+        for (std::thread::id id : finishedReaders) {
+            for (auto it = readerThreads.begin(); it != readerThreads.end(); ++it) {
+                if (it->get_id() == id) {
+                    it->join();
+                    readerThreads.erase(it);
+                    break;
+                }
+            }
+        }
+        finishedReaders.clear();
+    }
+
+    void readLoop(int fd, in_addr_t source) {
+        std::vector<char> buffer;
+        size_t used = 0;
+        uint32_t peer = static_cast<uint32_t>(MAX_NODES);  // unknown until HELLO
+        bool healthy = true;
+        buffer.resize(64 * 1024);
+
+        while (healthy && !stopping.load()) {
+            if (used == buffer.size()) buffer.resize(buffer.size() * 2);
+            ssize_t received = recv(fd, buffer.data() + used, buffer.size() - used, 0);
+            if (received <= 0) {
+                if (received < 0 && errno == EINTR) continue;
+                break;
+            }
+            used += static_cast<size_t>(received);
+
+            size_t offset = 0;
+            while (used - offset >= sizeof(LinkHeader)) {
+                LinkHeader header;
+                memcpy(&header, buffer.data() + offset, sizeof(header));
+                uint32_t length = ntohl(header.length);
+                if (length > MAX_LINK_FRAME) {
+                    healthy = false;
+                    break;
+                }
+                if (used - offset < sizeof(header) + length) break;
+                if (!handleFrame(peer, source, header.kind, ntohs(header.groupID), ntohl(header.value),
+                                 buffer.data() + offset + sizeof(header), length)) {
+                    healthy = false;
+                    break;
+                }
+                offset += sizeof(header) + length;
+            }
+            memmove(buffer.data(), buffer.data() + offset, used - offset);
+            used -= offset;
+        }
+
+        std::lock_guard<std::mutex> lock(inboundMutex);
+        for (size_t i = 0; i < inboundFds.size(); ++i) {
+            if (inboundFds[i] == fd) {
+                inboundFds.erase(inboundFds.begin() + i);
+                break;
+            }
+        }
+        finishedReaders.push_back(std::this_thread::get_id());
+        close(fd);
+    }
+
+    // Runs on the link's reader thread, so frames from one peer are
+    // handled in the order it sent them. Returns false if the link must be
+    // dropped: a HELLO from an address or with a secret that is not the
+    // claimed node's.
+    bool handleFrame(uint32_t& peer, in_addr_t source, uint8_t kind, uint16_t groupID,
+                     uint32_t value, const char* body, size_t length) {
+        if (kind == LINK_HELLO) {
+            if (value >= nodeCount || value == nodeIndex || !fromNode(value, source) ||
+                !secretMatches(body, length)) {
+                if (rejectedCounter) rejectedCounter->add();
+                return false;
+            }
+            // A new session: its subscriptions are replayed right after
+            peer = value;
+            uint64_t keep = ~(1ull << peer);
+            for (size_t i = 0; i < 65536; ++i) {
+                subscribers[i].fetch_and(keep, std::memory_order_relaxed);
+            }
+            return true;
+        }
+        if (peer >= nodeCount) return true;
+
+        ChatPacket packet;
+        switch (kind) {
+            case LINK_GROUP:
+                if (ownerOf(groupID) == peer) {
+                    groups.restoreGroup(groupID, std::string(body, length), 0);
+                }
+                break;
+            case LINK_SUBSCRIBE:
+                subscribers[groupID].fetch_or(1ull << peer, std::memory_order_relaxed);
+                break;
+            case LINK_UNSUBSCRIBE:
+                subscribers[groupID].fetch_and(~(1ull << peer), std::memory_order_relaxed);
+                break;
+            case LINK_FORWARD:
+                if (owns(groupID) && decodeFrame(body, length, WIRE_V2, packet) > 0 && onForward) {
+                    onForward(packet);
+                }
+                break;
+            case LINK_DELIVER:
+                if (decodeFrame(body, length, WIRE_V2, packet) > 0 && onDeliver) {
+                    onDeliver(packet, value);
+                }
+                break;
+            case LINK_HISTORY_REQUEST: {
+                HistoryCursor cursor;
+                if (decodeFrame(body, length, WIRE_V2, packet) <= 0 ||
+                    !readHistoryCursor(packet, cursor) || !onHistoryRequest) {
+                    break;
+                }
+                std::vector<HistoryEntry> page;
+                onHistoryRequest(groupID, cursor, page);
+                std::string frames;
+                std::string reply;
+                for (const HistoryEntry& entry : page) {
+                    Frame frame(entry.packet, WIRE_V3, entry.sequence);
+                    reply.append(frame.data(), frame.size());
+                }
+                appendFrame(frames, LINK_HISTORY_REPLY, groupID, value, reply.data(), reply.size());
+                enqueue(peer, frames);
+                break;
+            }
+            case LINK_HISTORY_REPLY: {
+                std::vector<HistoryEntry> page;
+                size_t offset = 0;
+                while (offset < length) {
+                    uint32_t sequence;
+                    long consumed = decodeFrame(body + offset, length - offset, WIRE_V3, packet, &sequence);
+                    if (consumed <= 0) return true;
+                    page.emplace_back(sequence, packet);
+                    offset += static_cast<size_t>(consumed);
+                }
+                if (onHistoryReply) onHistoryReply(value, page);
+                break;
+            }
+            default:
+                break;
+        }
+        return true;
+    }
+
+public:
+    // Called on link reader threads
+    std::function<void(ChatPacket&)> onForward;        // owner: sequence, store, fan out
+    std::function<void(const ChatPacket&, uint32_t)> onDeliver;  // fan out to local members
+    std::function<void(uint16_t, const HistoryCursor&, std::vector<HistoryEntry>&)> onHistoryRequest;
+    std::function<void(uint32_t, const std::vector<HistoryEntry>&)> onHistoryReply;
+
+    // peers lists every node, this one included, in node order
+    Federation(uint32_t node, const std::vector<PeerAddress>& nodes, GroupManager& groupManager)
+        : nodeIndex(node), nodeCount(static_cast<uint32_t>(nodes.size())), peers(nodes),
+          groups(groupManager), stopping(false), listenFd(-1),
+          subscribers(new std::atomic<uint64_t>[65536]),
+          forwardedCounter(nullptr), relayedCounter(nullptr), batchesCounter(nullptr),
+          droppedCounter(nullptr), rejectedCounter(nullptr) {
+        for (size_t i = 0; i < 65536; ++i) {
+            subscribers[i].store(0, std::memory_order_relaxed);
+        }
+        for (uint32_t i = 0; i < nodeCount; ++i) {
+            links.emplace_back(i == nodeIndex ? nullptr : new PeerLink(i, peers[i]));
+        }
+    }
+
+    ~Federation() {
+        stop();
+    }
+
+    Federation(const Federation&) = delete;
+    Federation& operator=(const Federation&) = delete;
+
+    void attachMetrics(MetricsRegistry& registry) {
+        forwardedCounter = &registry.counter("federation.forwarded");
+        relayedCounter = &registry.counter("federation.relayed");
+        batchesCounter = &registry.counter("federation.batches");
+        droppedCounter = &registry.counter("federation.dropped");
+        rejectedCounter = &registry.counter("federation.rejected");
+        registry.sampled("federation.peers_connected", [this]() {
+            int64_t connected = 0;
+            for (const auto& link : links) {
+                if (link && link->connected.load()) ++connected;
+            }
+            return connected;
+        });
+    }
+
+    // Read the secret every peer's HELLO must carry (the first line of
+    // path; all nodes share one). Fails on a missing or empty file. Call
+    // before start().
+    bool loadSecret(const std::string& path) {
+        std::ifstream file(path);
+        if (!file || !std::getline(file, secret)) return false;
+        if (!secret.empty() && secret.back() == '\r') secret.pop_back();
+        return !secret.empty() && secret.size() <= MAX_LINK_FRAME;
+    }
+
+    // Listen on this node's peer address and start dialing the others.
+    // Fails if a peer host does not resolve.
+    bool start() {
+        for (const PeerAddress& peer : peers) {
+            peerHosts.push_back(resolve(peer.host));
+            if (peerHosts.back().empty()) return false;
+        }
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listenFd < 0) return false;
+        int on = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = peerHosts[nodeIndex].front();
+        address.sin_port = htons(static_cast<uint16_t>(peers[nodeIndex].port));
+        if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 ||
+            listen(listenFd, SOMAXCONN) < 0) {
+            close(listenFd);
+            listenFd = -1;
+            return false;
+        }
+
+        acceptThread = std::thread([this] { acceptLoop(); });
+        for (auto& link : links) {
+            if (link) {
+                PeerLink* peer = link.get();
+                peer->thread = std::thread([this, peer] { linkLoop(*peer); });
+            }
+        }
+        return true;
+    }
+
+    void stop() {
+        if (stopping.exchange(true)) return;
+        for (auto& link : links) {
+            if (!link) continue;
+            {
+                // Orders the flag against a link thread about to wait
+                std::lock_guard<std::mutex> lock(link->mutex);
+            }
+            link->wake.notify_all();
+            if (link->thread.joinable()) link->thread.join();
+        }
+        if (acceptThread.joinable()) acceptThread.join();
+        if (listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+        std::vector<std::thread> readers;
+        {
+            std::lock_guard<std::mutex> lock(inboundMutex);
+            for (int fd : inboundFds) {
+                shutdown(fd, SHUT_RDWR);
+            }
+            readers.swap(readerThreads);
+        }
+        for (auto& reader : readers) {
+            reader.join();
+        }
+    }
+
+    uint32_t getNodeIndex() const {
+        return nodeIndex;
+    }
+
+    uint32_t getNodeCount() const {
+        return nodeCount;
+    }
+
+    uint32_t ownerOf(uint16_t groupID) const {
+        return groupID % nodeCount;
+    }
+
+    bool owns(uint16_t groupID) const {
+        return ownerOf(groupID) == nodeIndex;
+    }
+
+    // Hand a client's message to the group's owner for sequencing
+    void forward(const ChatPacket& packet) {
+        std::string frames;
+        appendPacket(frames, LINK_FORWARD, 0, packet);
+        enqueue(ownerOf(packet.groupID), frames);
+        if (forwardedCounter) forwardedCounter->add();
+    }
+
+    // Owner: pass a sequenced message to every node with members. Call
+    // under the group's publishMutex so relays leave in sequence order.
+    void relay(const ChatPacket& packet, uint32_t sequence) {
+        uint64_t nodes = subscribers[packet.groupID].load(std::memory_order_relaxed);
+        if (nodes == 0) return;
+        std::string frames;
+        appendPacket(frames, LINK_DELIVER, sequence, packet);
+        for (uint32_t node = 0; node < nodeCount; ++node) {
+            if ((nodes & (1ull << node)) && node != nodeIndex) {
+                enqueue(node, frames);
+                if (relayedCounter) relayedCounter->add();
+            }
+        }
+    }
+
+    // Tell every peer about a group this node created
+    void announceGroup(uint16_t groupID, const std::string& name) {
+        std::string frames;
+        appendFrame(frames, LINK_GROUP, groupID, 0, name.data(), name.size());
+        for (uint32_t node = 0; node < nodeCount; ++node) {
+            enqueue(node, frames);
+        }
+    }
+
+    // After a local join: make sure the owner relays the group here
+    void subscribe(uint16_t groupID) {
+        if (owns(groupID)) return;
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        if (!subscribed.insert(groupID).second) return;
+        std::string frames;
+        appendFrame(frames, LINK_SUBSCRIBE, groupID, 0, nullptr, 0);
+        enqueue(ownerOf(groupID), frames);
+    }
+
+    // Drop subscriptions for groups whose local members have all left.
+    // Call periodically; a join racing with it re-subscribes after.
+    void sweep() {
+        std::lock_guard<std::mutex> lock(subscriptionMutex);
+        for (auto it = subscribed.begin(); it != subscribed.end();) {
+            ChatGroup* group = groups.getGroup(*it);
+            if (group && group->getMemberCount() > 0) {
+                ++it;
+                continue;
+            }
+            std::string frames;
+            appendFrame(frames, LINK_UNSUBSCRIBE, *it, 0, nullptr, 0);
+            enqueue(ownerOf(*it), frames);
+            it = subscribed.erase(it);
+        }
+    }
+
+    // Ask the owner for a page of history on behalf of a local client; the
+    // reply arrives through onHistoryReply
+    void requestHistory(uint32_t clientID, uint16_t groupID, const HistoryCursor& cursor) {
+        ChatPacket request;
+        request.type = MSG_HISTORY;
+        request.groupID = groupID;
+        request.senderID = clientID;
+        writeHistoryCursor(request, cursor);
+        std::string frames;
+        appendPacket(frames, LINK_HISTORY_REQUEST, clientID, request);
+        enqueue(ownerOf(groupID), frames);
+    }
+};
+
+#endif // FEDERATION_H
@@ -1,109 +1,308 @@
 #ifndef GROUP_MANAGER_H
 #define GROUP_MANAGER_H
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 #include <mutex>
 #include <string>
+#include <memory>
 #include "../shared/protocol.h"
 
 struct ChatGroup {
     uint16_t groupID;
     std::string groupName;
-    std::unordered_set<uint32_t> members;
+    
+    // Serializes membership changes; readers never take it
     std::mutex groupMutex;
     
+    // Held while a message is sequenced, stored and fanned out, so every
+    // member sees the group's messages in sequence order
+    std::mutex publishMutex;
+    uint32_t lastSequence;
+    
+private:
+    // Sorted member IDs, immutable once published. A change copies the
+    // current list, swaps the pointer and frees the old list once no reader
+    // can still be using it.
+    std::atomic<const std::vector<uint32_t>*> members;
+    
+    // Left-right style reader accounting: readers register on the side
+    // named by the epoch, and a writer drains both sides (flipping the
+    // epoch in between so new readers cannot keep the old side busy)
+    // before freeing the list it replaced
+    alignas(64) std::atomic<uint32_t> readers[2];
+    std::atomic<uint32_t> epoch;
+    
+    void waitForReaders(uint32_t side) {
+        while (readers[side].load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+    
+    // Caller holds groupMutex
+    void publish(const std::vector<uint32_t>* next) {
+        const std::vector<uint32_t>* previous = members.exchange(next);
+        uint32_t current = epoch.load();
+        waitForReaders((current + 1) & 1);
+        epoch.store(current + 1);
+        waitForReaders(current & 1);
+        delete previous;
+    }
+    
+public:
     ChatGroup(uint16_t id, const std::string& name) 
-        : groupID(id), groupName(name) {}
+        : groupID(id), groupName(name), lastSequence(0),
+          members(new std::vector<uint32_t>()), epoch(0) {
+        readers[0].store(0);
+        readers[1].store(0);
+    }
+    
+    ~ChatGroup() {
+        delete members.load();
+    }
     
     void addMember(uint32_t clientID) {
         std::lock_guard<std::mutex> lock(groupMutex);
-        members.insert(clientID);
+        const std::vector<uint32_t>* current = members.load();
+        auto pos = std::lower_bound(current->begin(), current->end(), clientID);
+        if (pos != current->end() && *pos == clientID) return;
+        
+        auto next = new std::vector<uint32_t>();
+        next->reserve(current->size() + 1);
+        next->insert(next->end(), current->begin(), pos);
+        next->push_back(clientID);
+        next->insert(next->end(), pos, current->end());
+        publish(next);
     }
     
     void removeMember(uint32_t clientID) {
         std::lock_guard<std::mutex> lock(groupMutex);
-        members.erase(clientID);
+        const std::vector<uint32_t>* current = members.load();
+        auto pos = std::lower_bound(current->begin(), current->end(), clientID);
+        if (pos == current->end() || *pos != clientID) return;
+        
+        auto next = new std::vector<uint32_t>();
+        next->reserve(current->size() - 1);
+        next->insert(next->end(), current->begin(), pos);
+        next->insert(next->end(), pos + 1, current->end());
+        publish(next);
+    }
+    
+    // Call fn with the current member list without locking or copying.
+    // The list stays valid until fn returns; a concurrent join or leave
+    // waits for fn instead, so keep it short and never change this group's
+    // membership from inside it.
+    template <typename Fn>
+    void withMembers(Fn&& fn) {
+        uint32_t side = epoch.load() & 1;
+        readers[side].fetch_add(1);
+        fn(*members.load());
+        readers[side].fetch_sub(1);
     }
     
     std::vector<uint32_t> getMembers() {
-        std::lock_guard<std::mutex> lock(groupMutex);
-        return std::vector<uint32_t>(members.begin(), members.end());
+        std::vector<uint32_t> result;
+        withMembers([&result](const std::vector<uint32_t>& list) { result = list; });
+        return result;
+    }
+    
+    bool isMember(uint32_t clientID) {
+        bool found = false;
+        withMembers([clientID, &found](const std::vector<uint32_t>& list) {
+            found = std::binary_search(list.begin(), list.end(), clientID);
+        });
+        return found;
     }
     
     size_t getMemberCount() {
-        std::lock_guard<std::mutex> lock(groupMutex);
-        return members.size();
+        size_t count = 0;
+        withMembers([&count](const std::vector<uint32_t>& list) { count = list.size(); });
+        return count;
     }
 };
 
 class GroupManager {
 private:
     std::unordered_map<uint16_t, std::shared_ptr<ChatGroup>> groups;
-    std::unordered_map<uint32_t, uint16_t> clientGroups; // client -> current group
+    // client -> sorted IDs of every group it subscribes to. Together with
+    // each group's sorted member list this is the whole subscription index:
+    // two bytes per subscription on the client side, four on the group side.
+    std::unordered_map<uint32_t, std::vector<uint16_t>> clientGroups;
     std::mutex managerMutex;
     uint16_t nextGroupID;
+    // Created IDs are congruent to idOffset modulo idStride, so federated
+    // nodes never hand out the same ID
+    uint16_t idStride;
+    uint16_t idOffset;
+    
+    // Lock-free lookup for the send path, one slot per possible group ID.
+    // Groups are never destroyed before the manager, so a published
+    // pointer stays valid.
+    std::unique_ptr<std::atomic<ChatGroup*>[]> groupTable;
+    
+    // Caller holds managerMutex
+    void addGroup(const std::shared_ptr<ChatGroup>& group) {
+        groups[group->groupID] = group;
+        groupTable[group->groupID].store(group.get(), std::memory_order_release);
+    }
     
 public:
-    GroupManager() : nextGroupID(1) {
+    GroupManager() : nextGroupID(1), idStride(1), idOffset(0),
+                     groupTable(new std::atomic<ChatGroup*>[65536]) {
+        for (size_t i = 0; i < 65536; ++i) {
+            groupTable[i].store(nullptr, std::memory_order_relaxed);
+        }
         // Create default group
         createGroup("General");
     }
     
+    // Returns 0 when every ID this node may hand out is taken
     uint16_t createGroup(const std::string& name) {
         std::lock_guard<std::mutex> lock(managerMutex);
-        uint16_t groupID = nextGroupID++;
-        groups[groupID] = std::make_shared<ChatGroup>(groupID, name);
+        uint16_t groupID = nextGroupID;
+        uint32_t tries = 0;
+        while (groupID == 0 || groupID % idStride != idOffset || getGroup(groupID)) {
+            if (++tries > 65536) return 0;
+            ++groupID;
+        }
+        nextGroupID = static_cast<uint16_t>(groupID + 1);
+        addGroup(std::make_shared<ChatGroup>(groupID, name));
         return groupID;
     }
     
+    // Only create IDs equal to offset modulo stride from now on
+    void setIdSpacing(uint16_t stride, uint16_t offset) {
+        std::lock_guard<std::mutex> lock(managerMutex);
+        idStride = stride > 0 ? stride : 1;
+        idOffset = static_cast<uint16_t>(offset % idStride);
+    }
+    
+    // Recreate a group recovered from the message log with its original ID,
+    // continuing its sequence numbers where the log left off. publishMutex
+    // is taken after managerMutex is released: resuming a session joins
+    // groups while holding their publishMutex.
+    void restoreGroup(uint16_t groupID, const std::string& name, uint32_t lastSequence) {
+        ChatGroup* group;
+        {
+            std::lock_guard<std::mutex> lock(managerMutex);
+            auto it = groups.find(groupID);
+            if (it == groups.end()) {
+                addGroup(std::make_shared<ChatGroup>(groupID, 
+                    name.empty() ? "Group " + std::to_string(groupID) : name));
+                it = groups.find(groupID);
+            } else if (!name.empty()) {
+                it->second->groupName = name;
+            }
+            group = it->second.get();
+            if (groupID >= nextGroupID) {
+                nextGroupID = groupID + 1;
+            }
+        }
+        
+        std::lock_guard<std::mutex> publishLock(group->publishMutex);
+        if (lastSequence > group->lastSequence) {
+            group->lastSequence = lastSequence;
+        }
+    }
+    
+    static const size_t MAX_GROUPS_PER_CLIENT = 256;
+    
+    // Subscribe a client to one more group. Joining a group it already
+    // follows succeeds without change; fails for an unknown group or once
+    // the client follows MAX_GROUPS_PER_CLIENT groups.
     bool joinGroup(uint32_t clientID, uint16_t groupID) {
         std::lock_guard<std::mutex> lock(managerMutex);
         
-        auto it = groups.find(groupID);
-        if (it == groups.end()) {
+        ChatGroup* group = getGroup(groupID);
+        if (!group) {
             return false;
         }
         
-        // Leave current group if any
-        auto currentIt = clientGroups.find(clientID);
-        if (currentIt != clientGroups.end()) {
-            auto currentGroup = groups.find(currentIt->second);
-            if (currentGroup != groups.end()) {
-                currentGroup->second->removeMember(clientID);
-            }
+        // The client's entry is only created once the join succeeds
+        auto it = clientGroups.find(clientID);
+        if (it == clientGroups.end()) {
+            clientGroups[clientID].push_back(groupID);
+            group->addMember(clientID);
+            return true;
         }
         
-        // Join new group
-        it->second->addMember(clientID);
-        clientGroups[clientID] = groupID;
+        std::vector<uint16_t>& subscribed = it->second;
+        auto pos = std::lower_bound(subscribed.begin(), subscribed.end(), groupID);
+        if (pos != subscribed.end() && *pos == groupID) {
+            return true;
+        }
+        if (subscribed.size() >= MAX_GROUPS_PER_CLIENT) {
+            return false;
+        }
+        
+        subscribed.insert(pos, groupID);
+        group->addMember(clientID);
         return true;
     }
     
-    void leaveGroup(uint32_t clientID) {
+    // Returns false if the client was not in the group
+    bool leaveGroup(uint32_t clientID, uint16_t groupID) {
         std::lock_guard<std::mutex> lock(managerMutex);
         
         auto it = clientGroups.find(clientID);
-        if (it != clientGroups.end()) {
-            auto group = groups.find(it->second);
-            if (group != groups.end()) {
-                group->second->removeMember(clientID);
-            }
+        if (it == clientGroups.end()) {
+            return false;
+        }
+        std::vector<uint16_t>& subscribed = it->second;
+        auto pos = std::lower_bound(subscribed.begin(), subscribed.end(), groupID);
+        if (pos == subscribed.end() || *pos != groupID) {
+            return false;
+        }
+        
+        subscribed.erase(pos);
+        if (subscribed.empty()) {
             clientGroups.erase(it);
         }
+        getGroup(groupID)->removeMember(clientID);
+        return true;
     }
     
-    std::vector<uint32_t> getGroupMembers(uint16_t groupID) {
+    // Disconnect cleanup: drop every subscription the client holds
+    void leaveAllGroups(uint32_t clientID) {
         std::lock_guard<std::mutex> lock(managerMutex);
         
-        auto it = groups.find(groupID);
-        if (it != groups.end()) {
-            return it->second->getMembers();
+        auto it = clientGroups.find(clientID);
+        if (it == clientGroups.end()) {
+            return;
+        }
+        for (uint16_t groupID : it->second) {
+            getGroup(groupID)->removeMember(clientID);
+        }
+        clientGroups.erase(it);
+    }
+    
+    std::vector<uint32_t> getGroupMembers(uint16_t groupID) {
+        ChatGroup* group = getGroup(groupID);
+        if (group) {
+            return group->getMembers();
         }
         return {};
     }
     
+    // Lock-free; see ChatGroup::withMembers. Returns false for an unknown group.
+    template <typename Fn>
+    bool withGroupMembers(uint16_t groupID, Fn&& fn) {
+        ChatGroup* group = getGroup(groupID);
+        if (!group) {
+            return false;
+        }
+        group->withMembers(std::forward<Fn>(fn));
+        return true;
+    }
+    
+    // Lock-free; the group lives as long as the manager
+    ChatGroup* getGroup(uint16_t groupID) {
+        return groupTable[groupID].load(std::memory_order_acquire);
+    }
+    
     std::vector<std::pair<uint16_t, std::string>> listGroups() {
         std::lock_guard<std::mutex> lock(managerMutex);
         
@@ -114,14 +313,15 @@ public:
         return result;
     }
     
-    uint16_t getClientGroup(uint32_t clientID) {
+    // Sorted IDs of the groups a client follows
+    std::vector<uint16_t> getClientGroups(uint32_t clientID) {
         std::lock_guard<std::mutex> lock(managerMutex);
         
         auto it = clientGroups.find(clientID);
         if (it != clientGroups.end()) {
             return it->second;
         }
-        return 0; // Not in any group
+        return {};
     }
 };
 
@@ -3,229 +3,1127 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <signal.h>
+#include <pthread.h>
 #include <cstring>
+#include <thread>
+#include <sys/resource.h>
 #include "../shared/protocol.h"
 #include "../shared/cache.h"
+#include "../shared/history_store.h"
 #include "../shared/utils.h"
+#include "../shared/metrics.h"
 #include "thread_pool.cpp"
 #include "group_manager.cpp"
+#include "server_config.cpp"
+#include "reactor.cpp"
+#include "uring_reactor.cpp"
+#include "connection_registry.cpp"
+#include "session_store.cpp"
 
 // Global objects
 LRUCache messageCache(200);
+HistoryStore* historyStore;
+MessageLog* messageLog = nullptr;
 GroupManager groupManager;
 Logger serverLogger("../logs/server_log.txt");
 ThreadPool* threadPool;
-int server_fd;
+ConnectionRegistry connectionRegistry;
+ContentFilter contentFilter;
+Federation* federation = nullptr;  // null when running standalone
+SessionStore sessionStore;
+bool sessionsEnabled = true;
+MediaServer* mediaServer = nullptr;  // null unless --media-port is set
 
-// Signal handler for graceful shutdown
-void signalHandler(int signum) {
-    serverLogger.log("Interrupt signal received. Shutting down server...");
-    close(server_fd);
-    delete threadPool;
-    exit(signum);
+// One reactor per shard; reactorCount is published once all are built so
+// the signal handlers never see a half-filled table
+Reactor* reactors[MAX_REACTORS];
+std::atomic<uint32_t> reactorCount(0);
+
+// Live metrics, dumped on SIGUSR1 and returned for MSG_STATS
+MetricsRegistry serverMetrics;
+Histogram& routeTime = serverMetrics.histogram("server.route", "ns");
+Histogram& fanoutTime = serverMetrics.histogram("server.fanout", "ns");
+Histogram& fanoutRecipients = serverMetrics.histogram("server.fanout_recipients", "members");
+Histogram& poolQueueWait = serverMetrics.histogram("pool.queue_wait", "ns");
+Gauge& poolQueueDepth = serverMetrics.gauge("pool.queue_depth");
+Counter& rateLimited = serverMetrics.counter("server.rate_limited");
+Counter& filterInvalid = serverMetrics.counter("filter.invalid");
+Counter& filterBlocked = serverMetrics.counter("filter.blocked");
+Counter& sessionsResumed = serverMetrics.counter("session.resumed");
+Counter& sessionReplayed = serverMetrics.counter("session.replayed");
+
+// Messages per second one connection may send; 0 = unlimited
+uint32_t messageRateLimit = 0;
+
+// Signal handler for graceful shutdown: wake every reactor and let main() unwind
+void signalHandler(int) {
+    for (uint32_t i = 0; i < reactorCount.load(); ++i) {
+        reactors[i]->stop();
+    }
+}
+
+// SIGUSR1: print the metrics from the first reactor's thread, not the handler
+void metricsSignalHandler(int) {
+    if (reactorCount.load() > 0) {
+        reactors[0]->notify();
+    }
 }
 
-void handleClient(int client_socket, uint32_t clientID, const std::string& clientIP) {
-    serverLogger.log("New client connected", clientID, clientIP);
+void sendPacket(const std::shared_ptr<Connection>& conn, const ChatPacket& packet) {
+    conn->owner->queueSend(conn, encodeFrame(packet, conn->wireVersion.load()));
+}
+
+// Split the group's members by owning reactor (the sender already gets an
+// ACK, so it is skipped) and post each reactor its slice. The reactors
+// resolve IDs in their own connection tables and encode once per wire
+// format, so the worker takes no locks beyond the mailboxes. Called under
+// the group's publishMutex, which keeps deliveries in sequence order.
+void broadcastToGroup(const ChatPacket& packet, uint32_t excludeID, uint32_t sequence) {
+    uint64_t start = monotonicNanos();
+    uint32_t shards = reactorCount.load();
+    uint32_t nodes = federation ? federation->getNodeCount() : 1;
+    std::shared_ptr<GroupDelivery> slices[MAX_REACTORS];
+    size_t recipients = 0;
     
-    char buffer[sizeof(ChatPacket)];
+    groupManager.withGroupMembers(packet.groupID, [&](const std::vector<uint32_t>& members) {
+        for (uint32_t clientID : members) {
+            if (clientID == excludeID) continue;
+            std::shared_ptr<GroupDelivery>& slice = slices[Reactor::shardOf(clientID, shards, nodes)];
+            if (!slice) {
+                slice = std::allocate_shared<GroupDelivery>(PoolAllocator<GroupDelivery>(), packet, sequence);
+                slice->members.reserve(members.size() / shards + 1);
+            }
+            slice->members.push_back(clientID);
+            ++recipients;
+        }
+    });
     
-    while (true) {
-        memset(buffer, 0, sizeof(buffer));
-        ssize_t bytesRead = recv(client_socket, buffer, sizeof(ChatPacket), 0);
-        
-        if (bytesRead <= 0) {
-            serverLogger.log("Client disconnected", clientID, clientIP);
-            groupManager.leaveGroup(clientID);
-            break;
+    for (uint32_t i = 0; i < shards; ++i) {
+        if (slices[i]) {
+            reactors[i]->queueDelivery(std::move(slices[i]));
+        }
+    }
+    
+    fanoutRecipients.record(recipients);
+    fanoutTime.record(monotonicNanos() - start);
+}
+
+// The metrics dump split into payload-sized chunks at line boundaries,
+// followed by the empty chunk that terminates every MSG_STATS reply
+void sendStats(const std::shared_ptr<Connection>& conn) {
+    std::string text = serverMetrics.dump();
+    size_t offset = 0;
+    while (offset < text.size()) {
+        size_t length = std::min(text.size() - offset, MAX_PAYLOAD_SIZE - 1);
+        if (offset + length < text.size()) {
+            size_t lineEnd = text.rfind('\n', offset + length - 1);
+            if (lineEnd != std::string::npos && lineEnd >= offset) {
+                length = lineEnd - offset + 1;
+            }
         }
         
-        ChatPacket packet;
-        memcpy(&packet, buffer, sizeof(ChatPacket));
-        packet.toHostOrder();
-        
-        ChatPacket response;
-        response.senderID = 0; // Server ID
-        response.timestamp = getCurrentTimestamp();
+        ChatPacket chunk;
+        chunk.type = MSG_STATS;
+        chunk.timestamp = getCurrentTimestamp();
+        memcpy(chunk.payload, text.data() + offset, length);
+        chunk.payload[length] = '\0';
+        chunk.payloadSize = static_cast<uint16_t>(length);
+        sendPacket(conn, chunk);
+        offset += length;
+    }
+}
+
+// Fixed one-second windows on the coarse clock. A window is reset by the
+// first message after it ends, so no timer is needed to expire it. Runs on
+// the connection's task, never concurrently for one connection.
+bool allowMessage(Connection& conn) {
+    if (messageRateLimit == 0) return true;
+    uint64_t now = CoarseClock::nowMs();
+    if (now - conn.rateWindowStart >= 1000) {
+        conn.rateWindowStart = now;
+        conn.rateCount = 0;
+    }
+    return ++conn.rateCount <= messageRateLimit;
+}
+
+// Up to `limit` messages on one side of a cursor, oldest first. The
+// in-memory ring answers when it reaches back far enough; the messages just
+// past it come from the LRU cache while it still holds them, and the rest
+// (or all of them after a restart) from the durable log.
+std::vector<HistoryEntry> loadHistory(uint16_t groupID, const HistoryCursor& cursor, size_t limit) {
+    ChatPacket packet;
+    if (cursor.direction == HISTORY_BEFORE) {
+        std::vector<HistoryEntry> history = historyStore->before(groupID, cursor.sequence, limit);
+        uint32_t before = history.empty() ? cursor.sequence : history.front().sequence;
         
-        switch (packet.type) {
-            case MSG_JOIN_GROUP: {
-                uint16_t groupID = packet.groupID;
-                if (groupManager.joinGroup(clientID, groupID)) {
-                    response.type = MSG_ACK;
-                    snprintf(response.payload, sizeof(response.payload), 
-                            "Joined group %d", groupID);
-                    serverLogger.log("Client joined group " + std::to_string(groupID), 
-                                   clientID, clientIP);
-                    
-                    // Send recent message history
-                    auto history = messageCache.getGroupHistory(groupID, 10);
-                    for (const auto& msg : history) {
-                        ChatPacket histMsg = msg;
-                        histMsg.toNetworkOrder();
-                        send(client_socket, &histMsg, sizeof(ChatPacket), 0);
-                    }
-                } else {
-                    response.type = MSG_ERROR;
-                    snprintf(response.payload, sizeof(response.payload), 
-                            "Failed to join group %d", groupID);
-                }
+        // Sequences are contiguous per group, so walk down until a miss
+        std::vector<HistoryEntry> older;
+        while (before > 1 && history.size() + older.size() < limit &&
+               messageCache.get(groupID, before - 1, packet)) {
+            older.emplace_back(--before, packet);
+        }
+        if (messageLog && before != 1 && history.size() + older.size() < limit) {
+            std::vector<HistoryEntry> logged =
+                messageLog->readBefore(groupID, before, limit - history.size() - older.size());
+            older.insert(older.end(), logged.rbegin(), logged.rend());
+        }
+        std::reverse(older.begin(), older.end());
+        older.insert(older.end(), history.begin(), history.end());
+        return older;
+    }
+    
+    std::vector<HistoryEntry> history;
+    uint32_t after = cursor.sequence;
+    uint32_t oldest = historyStore->oldestSequence(groupID);
+    while (history.size() < limit && oldest > after + 1 && messageCache.get(groupID, after + 1, packet)) {
+        history.emplace_back(++after, packet);
+    }
+    if (messageLog && history.size() < limit && (oldest == 0 || oldest > after + 1)) {
+        std::vector<HistoryEntry> logged = messageLog->readAfter(groupID, after, limit - history.size());
+        if (!logged.empty()) after = logged.back().sequence;
+        history.insert(history.end(), logged.begin(), logged.end());
+    }
+    if (history.size() < limit) {
+        std::vector<HistoryEntry> newer = historyStore->after(groupID, after, limit - history.size());
+        history.insert(history.end(), newer.begin(), newer.end());
+    }
+    return history;
+}
+
+// One page of history: the messages as MSG_HISTORY packets (media notices
+// as themselves), then the HistoryPage that closes the reply (sequence 0)
+std::vector<HistoryEntry> buildHistoryPage(uint16_t groupID, const HistoryCursor& cursor) {
+    size_t limit = std::min<size_t>(cursor.limit == 0 ? 10 : cursor.limit, HISTORY_PAGE_MAX);
+    
+    // One extra message tells whether another page follows
+    std::vector<HistoryEntry> history = loadHistory(groupID, cursor, limit + 1);
+    bool more = history.size() > limit;
+    if (more) {
+        if (cursor.direction == HISTORY_BEFORE) {
+            history.erase(history.begin());
+        } else {
+            history.pop_back();
+        }
+    }
+    
+    std::vector<HistoryEntry> packets;
+    packets.reserve(history.size() + 1);
+    for (const auto& entry : history) {
+        packets.push_back(entry);
+        // Media notices keep their type: the payload is a descriptor, not text
+        if (entry.packet.type == MSG_TEXT) {
+            packets.back().packet.type = MSG_HISTORY;
+        }
+    }
+    
+    HistoryPage page;
+    page.firstSequence = history.empty() ? 0 : history.front().sequence;
+    page.lastSequence = history.empty() ? 0 : history.back().sequence;
+    page.count = static_cast<uint16_t>(history.size());
+    page.more = more ? 1 : 0;
+    
+    ChatPacket closing;
+    closing.type = MSG_HISTORY;
+    closing.groupID = groupID;
+    closing.timestamp = getCurrentTimestamp();
+    writeHistoryPage(closing, page);
+    packets.emplace_back(0, closing);
+    return packets;
+}
+
+// Queue several packets as one batch, so nothing interleaves with them
+void sendPackets(const std::shared_ptr<Connection>& conn, const std::vector<HistoryEntry>& packets) {
+    WireVersion version = conn->wireVersion.load();
+    std::vector<FramePtr> frames;
+    frames.reserve(packets.size());
+    for (const auto& entry : packets) {
+        frames.push_back(encodeFrame(entry.packet, version, entry.sequence));
+    }
+    conn->owner->queueSend(conn, frames.data(), frames.size());
+}
+
+// Sequence, store and fan out one message. Runs on the group's owning
+// node, for local senders and for messages forwarded by peers alike.
+void publishMessage(ChatGroup* group, const ChatPacket& packet) {
+    std::lock_guard<std::mutex> lock(group->publishMutex);
+    uint32_t sequence = ++group->lastSequence;
+    
+    // Ring, cache and log: newest to oldest tier of history
+    messageCache.put(packet, sequence);
+    historyStore->append(packet, sequence);
+    if (messageLog) {
+        messageLog->append(packet, sequence);
+    }
+    
+    // Broadcast to all group members, here and on peer nodes
+    broadcastToGroup(packet, packet.senderID, sequence);
+    if (federation) {
+        federation->relay(packet, sequence);
+    }
+}
+
+// The groups a client follows, each with the newest sequence published in
+// it so far; nothing newer can have reached the client yet
+std::vector<ResumePosition> currentPositions(uint32_t clientID) {
+    std::vector<ResumePosition> positions;
+    for (uint16_t groupID : groupManager.getClientGroups(clientID)) {
+        ChatGroup* group = groupManager.getGroup(groupID);
+        ResumePosition position;
+        position.groupID = groupID;
+        {
+            std::lock_guard<std::mutex> lock(group->publishMutex);
+            position.sequence = group->lastSequence;
+        }
+        positions.push_back(position);
+    }
+    return positions;
+}
+
+// MSG_RESUME: attach the connection to its session, rejoin the session's
+// groups and replay what the client missed in each. The reply goes first.
+// Each group is joined and its replay queued under the group's
+// publishMutex, so the replay sits exactly between what the client had
+// and the first live message after it. Groups owned by another node are
+// replayed by their owner, and live messages may overtake that replay.
+void resumeSession(const std::shared_ptr<Connection>& conn, const ChatPacket& packet) {
+    uint32_t clientID = conn->clientID;
+    ChatPacket response;
+    response.timestamp = getCurrentTimestamp();
+    
+    uint8_t tokenBytes[SESSION_TOKEN_SIZE];
+    ResumePosition reported[MAX_RESUME_POSITIONS];
+    size_t reportedCount = 0;
+    const char* error = nullptr;
+    if (!sessionsEnabled) {
+        error = "Session resumption is disabled";
+    } else if (!readResumeRequest(packet, tokenBytes, reported, reportedCount)) {
+        error = "Malformed resume request";
+    } else if (sessionStore.isAttached(clientID)) {
+        error = "Session already established";
+    }
+    if (error) {
+        response.type = MSG_ERROR;
+        snprintf(response.payload, sizeof(response.payload), "%s", error);
+        response.payloadSize = strlen(response.payload);
+        sendPacket(conn, response);
+        return;
+    }
+    
+    std::string token(reinterpret_cast<const char*>(tokenBytes), SESSION_TOKEN_SIZE);
+    std::vector<ResumePosition> positions;
+    uint32_t previousClientID;
+    ResumeStatus status = sessionStore.resume(token, clientID, positions, previousClientID);
+    if (previousClientID != 0) {
+        // Taken over from a connection the server has not seen close yet
+        positions = currentPositions(previousClientID);
+    }
+    
+    // Where the client says it got to wins over the disconnect snapshot:
+    // messages queued to the old connection may never have arrived
+    for (auto& position : positions) {
+        for (size_t i = 0; i < reportedCount; ++i) {
+            if (reported[i].groupID == position.groupID) {
+                position.sequence = reported[i].sequence;
                 break;
             }
-            
-            case MSG_CREATE_GROUP: {
-                std::string groupName(packet.payload);
-                uint16_t newGroupID = groupManager.createGroup(groupName);
+        }
+    }
+    
+    ResumeReply reply;
+    memcpy(reply.token, token.data(), SESSION_TOKEN_SIZE);
+    reply.status = status;
+    reply.groups = static_cast<uint16_t>(positions.size());
+    response.type = MSG_RESUME;
+    writeResumeReply(response, reply);
+    sendPacket(conn, response);
+    
+    for (const auto& position : positions) {
+        ChatGroup* group = groupManager.getGroup(position.groupID);
+        if (!group) continue;
+        HistoryCursor cursor;
+        cursor.direction = HISTORY_AFTER;
+        cursor.sequence = position.sequence;
+        cursor.limit = HISTORY_PAGE_MAX;
+        
+        if (federation && !federation->owns(position.groupID)) {
+            groupManager.joinGroup(clientID, position.groupID);
+            federation->subscribe(position.groupID);
+            federation->requestHistory(clientID, position.groupID, cursor);
+            continue;
+        }
+        
+        std::lock_guard<std::mutex> lock(group->publishMutex);
+        groupManager.joinGroup(clientID, position.groupID);
+        std::vector<HistoryEntry> page = buildHistoryPage(position.groupID, cursor);
+        sessionReplayed.add(page.size() - 1);
+        sendPackets(conn, page);
+    }
+    
+    if (status == RESUME_RESTORED) {
+        sessionsResumed.add();
+        serverLogger.log("Client resumed session with " + std::to_string(positions.size()) +
+                         " group(s)", clientID, conn->clientIP);
+    }
+}
+
+// MSG_AUDIO / MSG_VIDEO from a client offers an upload to a group it is
+// in. The reply (from sender 0) is the ticket for the media connection;
+// the group hears about the object only once its bytes are all in.
+void offerMedia(const std::shared_ptr<Connection>& conn, const ChatPacket& packet) {
+    uint32_t clientID = conn->clientID;
+    ChatPacket response;
+    response.type = MSG_ERROR;
+    response.groupID = packet.groupID;
+    response.timestamp = getCurrentTimestamp();
+    
+    MediaDescriptor offer;
+    std::string name;
+    ChatGroup* group = groupManager.getGroup(packet.groupID);
+    if (!mediaServer) {
+        snprintf(response.payload, sizeof(response.payload), "Media transfer is disabled");
+    } else if (!readMediaDescriptor(packet, offer, name)) {
+        snprintf(response.payload, sizeof(response.payload), "Malformed media offer");
+    } else if (!group || !group->isMember(clientID)) {
+        snprintf(response.payload, sizeof(response.payload), 
+                "Not a member of group %d", packet.groupID);
+    } else if (offer.size == 0 || offer.size > mediaServer->getMaxBytes()) {
+        snprintf(response.payload, sizeof(response.payload), "Media must be 1 to %llu bytes",
+                 static_cast<unsigned long long>(mediaServer->getMaxBytes()));
+    } else if (!allowMessage(*conn)) {
+        rateLimited.add();
+        snprintf(response.payload, sizeof(response.payload), 
+                "Rate limit exceeded (%u messages per second)", messageRateLimit);
+    } else {
+        MediaDescriptor ticket;
+        UploadResult result = mediaServer->createUpload(packet.type, packet.groupID, clientID,
+                                                        offer.size, name, ticket);
+        if (result == UPLOAD_CREATED) {
+            response.type = packet.type;
+            writeMediaDescriptor(response, ticket, name);
+            sendPacket(conn, response);
+            serverLogger.log("Media upload " + std::to_string(ticket.mediaID) + " offered for group " +
+                             std::to_string(packet.groupID), clientID, conn->clientIP);
+            return;
+        }
+        snprintf(response.payload, sizeof(response.payload),
+                 result == UPLOAD_OVER_QUOTA ? "Media storage quota reached" : "Cannot store media");
+    }
+    response.payloadSize = strlen(response.payload);
+    sendPacket(conn, response);
+}
+
+// An upload finished: tell the group, as an ordinary sequenced message
+// from the uploader, so it is also kept in history and replayed on resume
+void announceMedia(const MediaInfo& media) {
+    ChatGroup* group = groupManager.getGroup(media.groupID);
+    if (!group) return;
+    
+    ChatPacket notice;
+    notice.type = media.kind;
+    notice.groupID = media.groupID;
+    notice.senderID = media.senderID;
+    notice.timestamp = getCurrentTimestamp();
+    MediaDescriptor descriptor;
+    descriptor.mediaID = media.mediaID;
+    descriptor.key = media.key;
+    descriptor.size = media.size;
+    descriptor.port = static_cast<uint16_t>(mediaServer->getPort());
+    writeMediaDescriptor(notice, descriptor, media.name);
+    
+    if (federation && !federation->owns(media.groupID)) {
+        federation->forward(notice);
+    } else {
+        publishMessage(group, notice);
+    }
+    serverLogger.log("Media " + std::to_string(media.mediaID) + " (" + std::to_string(media.size) +
+                     " bytes) shared in group " + std::to_string(media.groupID), media.senderID);
+}
+
+void handlePacket(const std::shared_ptr<Connection>& conn, ChatPacket& packet) {
+    uint32_t clientID = conn->clientID;
+    const std::string& clientIP = conn->clientIP;
+
+    ChatPacket response;
+    response.senderID = 0; // Server ID
+    response.timestamp = getCurrentTimestamp();
+    
+    PayloadVerdict verdict = contentFilter.check(packet);
+    if (verdict != PAYLOAD_OK) {
+        (verdict == PAYLOAD_BLOCKED ? filterBlocked : filterInvalid).add();
+        response.type = MSG_ERROR;
+        response.groupID = packet.groupID;
+        snprintf(response.payload, sizeof(response.payload), "%s", verdictMessage(verdict));
+        response.payloadSize = strlen(response.payload);
+        sendPacket(conn, response);
+        return;
+    }
+    
+    switch (packet.type) {
+        case MSG_JOIN_GROUP: {
+            uint16_t groupID = packet.groupID;
+            if (groupManager.joinGroup(clientID, groupID)) {
+                if (federation) {
+                    federation->subscribe(groupID);
+                }
                 response.type = MSG_ACK;
-                response.groupID = newGroupID;
                 snprintf(response.payload, sizeof(response.payload), 
-                        "Created group '%s' with ID %d", groupName.c_str(), newGroupID);
-                serverLogger.log("Client created group: " + groupName, clientID, clientIP);
+                        "Joined group %d", groupID);
+                serverLogger.log("Client joined group " + std::to_string(groupID), 
+                               clientID, clientIP);
+            } else {
+                response.type = MSG_ERROR;
+                snprintf(response.payload, sizeof(response.payload), 
+                        "Failed to join group %d", groupID);
+            }
+            break;
+        }
+        
+        case MSG_CREATE_GROUP: {
+            std::string groupName(packet.payload, packet.payloadSize);
+            uint16_t newGroupID = groupManager.createGroup(groupName);
+            if (newGroupID == 0) {
+                response.type = MSG_ERROR;
+                snprintf(response.payload, sizeof(response.payload), "No free group IDs");
                 break;
             }
-            
-            case MSG_LIST_GROUPS: {
-                auto groups = groupManager.listGroups();
-                response.type = MSG_ACK;
-                std::string groupList;
-                for (const auto& group : groups) {
-                    groupList += std::to_string(group.first) + ":" + group.second + ";";
-                }
-                snprintf(response.payload, sizeof(response.payload), "%s", groupList.c_str());
+            if (messageLog) {
+                messageLog->recordGroup(newGroupID, groupName);
+            }
+            if (federation) {
+                federation->announceGroup(newGroupID, groupName);
+            }
+            response.type = MSG_ACK;
+            response.groupID = newGroupID;
+            snprintf(response.payload, sizeof(response.payload), 
+                    "Created group '%s' with ID %d", groupName.c_str(), newGroupID);
+            serverLogger.log("Client created group: " + groupName, clientID, clientIP);
+            break;
+        }
+        
+        case MSG_LIST_GROUPS: {
+            auto groups = groupManager.listGroups();
+            response.type = MSG_ACK;
+            std::string groupList;
+            for (const auto& group : groups) {
+                groupList += std::to_string(group.first) + ":" + group.second + ";";
+            }
+            snprintf(response.payload, sizeof(response.payload), "%s", groupList.c_str());
+            break;
+        }
+        
+        case MSG_TEXT: {
+            auto group = groupManager.getGroup(packet.groupID);
+            if (!group) {
+                response.type = MSG_ERROR;
+                snprintf(response.payload, sizeof(response.payload), 
+                        "No such group %d", packet.groupID);
                 break;
             }
-            
-            case MSG_TEXT: {
-                packet.senderID = clientID;
-                packet.timestamp = getCurrentTimestamp();
-                
-                // Cache the message
-                messageCache.put(packet);
-                
-                // Broadcast to all group members
-                auto members = groupManager.getGroupMembers(packet.groupID);
-                for (uint32_t memberID : members) {
-                    // In a real implementation, maintain socket map for each client
-                    // For now, just log
-                    serverLogger.log("Broadcasting message to client " + 
-                                   std::to_string(memberID), clientID, clientIP);
-                }
-                
-                response.type = MSG_ACK;
-                snprintf(response.payload, sizeof(response.payload), "Message sent");
-                
-                serverLogger.log("Message received for group " + 
-                               std::to_string(packet.groupID) + ": " + 
-                               std::string(packet.payload), clientID, clientIP);
+            if (!allowMessage(*conn)) {
+                rateLimited.add();
+                response.type = MSG_ERROR;
+                snprintf(response.payload, sizeof(response.payload), 
+                        "Rate limit exceeded (%u messages per second)", messageRateLimit);
                 break;
             }
             
-            case MSG_LEAVE_GROUP: {
-                groupManager.leaveGroup(clientID);
-                response.type = MSG_ACK;
-                snprintf(response.payload, sizeof(response.payload), "Left group");
-                serverLogger.log("Client left group", clientID, clientIP);
-                break;
+            packet.senderID = clientID;
+            packet.timestamp = getCurrentTimestamp();
+            
+            // Another node's group: its owner sequences and relays it back
+            if (federation && !federation->owns(packet.groupID)) {
+                federation->forward(packet);
+            } else {
+                publishMessage(group, packet);
             }
             
-            default:
+            response.type = MSG_ACK;
+            snprintf(response.payload, sizeof(response.payload), "Message sent");
+            
+            serverLogger.log("Message received for group " + 
+                           std::to_string(packet.groupID) + ": " + 
+                           std::string(packet.payload, packet.payloadSize), clientID, clientIP);
+            break;
+        }
+        
+        case MSG_RESUME: {
+            resumeSession(conn, packet);
+            return;
+        }
+        
+        case MSG_AUDIO:
+        case MSG_VIDEO: {
+            offerMedia(conn, packet);
+            return;
+        }
+        
+        case MSG_STATS: {
+            sendStats(conn);
+            response.type = MSG_STATS;
+            break;
+        }
+        
+        case MSG_HISTORY: {
+            HistoryCursor cursor;
+            ChatGroup* group = groupManager.getGroup(packet.groupID);
+            response.type = MSG_ERROR;
+            response.groupID = packet.groupID;
+            if (!readHistoryCursor(packet, cursor)) {
+                snprintf(response.payload, sizeof(response.payload), "Malformed history request");
+            } else if (!group) {
+                snprintf(response.payload, sizeof(response.payload), 
+                        "No such group %d", packet.groupID);
+            } else if (!group->isMember(clientID)) {
+                snprintf(response.payload, sizeof(response.payload), 
+                        "Not a member of group %d", packet.groupID);
+            } else if (federation && !federation->owns(packet.groupID)) {
+                // The owner holds the history; its reply is relayed as one batch
+                federation->requestHistory(clientID, packet.groupID, cursor);
+                return;
+            } else {
+                // The page carries its own closing packet
+                sendPackets(conn, buildHistoryPage(packet.groupID, cursor));
+                return;
+            }
+            break;
+        }
+        
+        case MSG_LEAVE_GROUP: {
+            // Group 0 (what single-group clients send) leaves every group
+            uint16_t groupID = packet.groupID;
+            response.groupID = groupID;
+            if (groupID == 0) {
+                groupManager.leaveAllGroups(clientID);
+                response.type = MSG_ACK;
+                snprintf(response.payload, sizeof(response.payload), "Left all groups");
+                serverLogger.log("Client left all groups", clientID, clientIP);
+            } else if (groupManager.leaveGroup(clientID, groupID)) {
+                response.type = MSG_ACK;
+                snprintf(response.payload, sizeof(response.payload), "Left group %d", groupID);
+                serverLogger.log("Client left group " + std::to_string(groupID), 
+                               clientID, clientIP);
+            } else {
                 response.type = MSG_ERROR;
-                snprintf(response.payload, sizeof(response.payload), "Unknown message type");
-                break;
+                snprintf(response.payload, sizeof(response.payload), 
+                        "Not a member of group %d", groupID);
+            }
+            break;
         }
         
-        response.payloadSize = strlen(response.payload);
-        response.toNetworkOrder();
-        send(client_socket, &response, sizeof(ChatPacket), 0);
+        default:
+            response.type = MSG_ERROR;
+            snprintf(response.payload, sizeof(response.payload), "Unknown message type");
+            break;
     }
     
-    close(client_socket);
+    response.payloadSize = strlen(response.payload);
+    sendPacket(conn, response);
 }
 
-int main(int argc, char* argv[]) {
-    // Setup signal handler
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
-    
-    int port = 8080;
-    if (argc > 1) {
-        port = atoi(argv[1]);
+void dispatchConnection(const std::shared_ptr<Connection>& conn);
+
+// Runs one queued item for a connection, then reschedules itself if more
+// work arrived. At most one task per connection is in the pool at a time,
+// so packets from one client are handled in the order they were received.
+void runConnectionTask(const std::shared_ptr<Connection>& conn) {
+    ChatPacket packet;
+    bool hasPacket = false;
+    bool finalize = false;
+    bool resume = false;
+    {
+        std::lock_guard<std::mutex> lock(conn->inboxMutex);
+        if (!conn->inbox.empty()) {
+            packet = conn->inbox.front();
+            conn->inbox.pop_front();
+            hasPacket = true;
+            // The reactor stopped reading at a full inbox; let it go on
+            // once half of it is handled
+            if (conn->readPaused && conn->inbox.size() <= Reactor::INBOX_LIMIT / 2) {
+                conn->readPaused = false;
+                resume = true;
+            }
+        } else if (conn->closed) {
+            finalize = true;
+        }
     }
-    
-    // Determine scheduling policy
-    SchedulingPolicy policy = ROUND_ROBIN;
-    if (argc > 2 && strcmp(argv[2], "sjf") == 0) {
-        policy = SHORTEST_JOB_FIRST;
-        serverLogger.log("Using Shortest Job First scheduling");
-    } else {
-        serverLogger.log("Using Round Robin scheduling");
+    if (resume) {
+        conn->owner->resumeReading(conn);
     }
     
-    threadPool = new ThreadPool(4, policy);
+    if (hasPacket) {
+        uint64_t start = monotonicNanos();
+        handlePacket(conn, packet);
+        routeTime.record(monotonicNanos() - start);
+    } else if (finalize) {
+        serverLogger.log(conn->evicted.load() ? "Client disconnected: outbound budget exceeded"
+                                              : "Client disconnected",
+                         conn->clientID, conn->clientIP);
+        connectionRegistry.remove(conn->clientID);
+        if (sessionStore.isAttached(conn->clientID)) {
+            sessionStore.detach(conn->clientID, currentPositions(conn->clientID));
+        }
+        groupManager.leaveAllGroups(conn->clientID);
+    }
     
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
+    {
+        std::lock_guard<std::mutex> lock(conn->inboxMutex);
+        if (finalize || (conn->inbox.empty() && !conn->closed)) {
+            conn->dispatching = false;
+            return;
+        }
+    }
+    dispatchConnection(conn);
+}
+
+// SJF cost class of a connection's next task: the type of the packet at
+// the front of its inbox (0 = disconnect cleanup; unknown types share the
+// last slot) times the log2 bucket of the addressed group's size, so
+// fan-out to a large group is measured apart from a small one. The front
+// packet is the one the task will handle: only that task pops the inbox.
+static const uint32_t COST_TYPE_SLOTS = 16;
+static const uint32_t COST_SIZE_BUCKETS = MAX_COST_CLASSES / COST_TYPE_SLOTS;
+
+uint32_t costClassOf(const std::shared_ptr<Connection>& conn) {
+    uint32_t type = 0;
+    uint16_t groupID = 0;
+    {
+        std::lock_guard<std::mutex> lock(conn->inboxMutex);
+        if (!conn->inbox.empty()) {
+            type = conn->inbox.front().type;
+            groupID = conn->inbox.front().groupID;
+        }
+    }
+    type = std::min(type, COST_TYPE_SLOTS - 1);
     
-    // Create socket
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    uint32_t bucket = 0;
+    ChatGroup* group = groupID ? groupManager.getGroup(groupID) : nullptr;
+    if (group) {
+        for (size_t members = group->getMemberCount(); members > 0; members >>= 1) {
+            ++bucket;
+        }
+    }
+    return type * COST_SIZE_BUCKETS + std::min(bucket, COST_SIZE_BUCKETS - 1);
+}
+
+void dispatchConnection(const std::shared_ptr<Connection>& conn) {
+    uint64_t queuedAt = monotonicNanos();
+    poolQueueDepth.add(1);
+    auto task = [conn, queuedAt]() {
+        poolQueueDepth.add(-1);
+        poolQueueWait.record(monotonicNanos() - queuedAt);
+        runConnectionTask(conn);
+    };
+    if (threadPool->getPolicy() == SHORTEST_JOB_FIRST) {
+        threadPool->enqueueMeasured(std::move(task), costClassOf(conn), conn->clientID);
+    } else {
+        threadPool->enqueue(std::move(task), 1, conn->clientID);
+    }
+}
+
+void scheduleConnection(const std::shared_ptr<Connection>& conn) {
+    {
+        std::lock_guard<std::mutex> lock(conn->inboxMutex);
+        if (conn->dispatching) return;
+        conn->dispatching = true;
+    }
+    dispatchConnection(conn);
+}
+
+void onClientPacket(const std::shared_ptr<Connection>& conn, const ChatPacket& packet) {
+    {
+        std::lock_guard<std::mutex> lock(conn->inboxMutex);
+        conn->inbox.push_back(packet);
+    }
+    scheduleConnection(conn);
+}
+
+void onClientDisconnect(const std::shared_ptr<Connection>& conn) {
+    {
+        std::lock_guard<std::mutex> lock(conn->inboxMutex);
+        conn->closed = true;
+    }
+    scheduleConnection(conn);
+}
+
+// Values owned by other components, read only when a dump is taken
+void registerSampledMetrics() {
+    serverMetrics.sampled("server.connections", []() {
+        return static_cast<int64_t>(connectionRegistry.size());
+    });
+    serverMetrics.sampled("cache.hits", []() {
+        uint64_t hits, misses, evictions;
+        messageCache.getStats(hits, misses, evictions);
+        return static_cast<int64_t>(hits);
+    });
+    serverMetrics.sampled("cache.misses", []() {
+        uint64_t hits, misses, evictions;
+        messageCache.getStats(hits, misses, evictions);
+        return static_cast<int64_t>(misses);
+    });
+    serverMetrics.sampled("cache.hit_rate_pct", []() {
+        uint64_t hits, misses, evictions;
+        messageCache.getStats(hits, misses, evictions);
+        return static_cast<int64_t>(hits + misses > 0 ? hits * 100 / (hits + misses) : 0);
+    });
+    serverMetrics.sampled("cache.expired", []() {
+        return static_cast<int64_t>(messageCache.getExpiredCount());
+    });
+    serverMetrics.sampled("cache.evictions", []() {
+        uint64_t hits, misses, evictions;
+        messageCache.getStats(hits, misses, evictions);
+        return static_cast<int64_t>(evictions);
+    });
+    serverMetrics.sampled("pool.tasks_processed", []() {
+        uint64_t processed, avgTime;
+        threadPool->getStats(processed, avgTime);
+        return static_cast<int64_t>(processed);
+    });
+    serverMetrics.sampled("pool.tasks_stolen", []() {
+        return static_cast<int64_t>(threadPool->getStolenCount());
+    });
+    serverMetrics.sampled("session.count", []() {
+        return static_cast<int64_t>(sessionStore.size());
+    });
+    serverMetrics.sampled("session.expired", []() {
+        return static_cast<int64_t>(sessionStore.getExpiredCount());
+    });
+    serverMetrics.sampled("logger.dropped", []() {
+        return static_cast<int64_t>(serverLogger.getDroppedCount());
+    });
+    if (messageLog) {
+        serverMetrics.sampled("log.records", []() {
+            uint64_t records, commits;
+            messageLog->getStats(records, commits);
+            return static_cast<int64_t>(records);
+        });
+        serverMetrics.sampled("log.commits", []() {
+            uint64_t records, commits;
+            messageLog->getStats(records, commits);
+            return static_cast<int64_t>(commits);
+        });
+        serverMetrics.sampled("log.failed", []() {
+            return static_cast<int64_t>(messageLog->getFailedCount());
+        });
+    }
+}
+
+// Listening socket on every interface. With reusePort several sockets
+// share the port and the kernel spreads incoming connections among them.
+int openListener(int port, bool reusePort) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
         std::cerr << "Socket creation failed" << std::endl;
         return -1;
     }
     
-    // Set socket options
     int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))) {
         std::cerr << "Setsockopt failed" << std::endl;
+        close(fd);
         return -1;
     }
     
+    struct sockaddr_in address;
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
     
-    // Bind
-    if (bind(server_fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
         std::cerr << "Bind failed" << std::endl;
+        close(fd);
         return -1;
     }
-    
-    // Listen
-    if (listen(server_fd, 10) < 0) {
+    if (listen(fd, SOMAXCONN) < 0) {
         std::cerr << "Listen failed" << std::endl;
+        close(fd);
         return -1;
     }
+    return fd;
+}
+
+// The configured backend, or epoll if io_uring cannot be set up
+Reactor* createReactor(IoBackend backend, int listenFd, std::atomic<uint32_t>& counter) {
+    if (backend == IO_URING) {
+        Reactor* candidate = new UringReactor(listenFd, counter);
+        if (candidate->init()) {
+            return candidate;
+        }
+        delete candidate;
+        serverLogger.log("io_uring unavailable, falling back to epoll");
+        std::cerr << "io_uring unavailable, falling back to epoll" << std::endl;
+    }
+    Reactor* candidate = new EpollReactor(listenFd, counter);
+    if (!candidate->init()) {
+        delete candidate;
+        return nullptr;
+    }
+    return candidate;
+}
+
+void pinToCore(pthread_t thread, size_t core) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(core, &cpus);
+    pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+}
+
+// Idle connections cost one descriptor each; lift the soft limit to the hard one
+void raiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Setup signal handler
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+    signal(SIGUSR1, metricsSignalHandler);
+    signal(SIGPIPE, SIG_IGN);
+    raiseFileLimit();
+    
+    ServerConfig config;
+    if (!parseServerArgs(argc, argv, config)) {
+        printServerUsage(argv[0]);
+        return -1;
+    }
+    int port = config.port;
+    uint32_t nodes = config.peers.empty() ? 1 : static_cast<uint32_t>(config.peers.size());
+    
+    if (config.asyncLog) {
+        serverLogger.startAsync(8192, config.logFlushMs);
+    }
+    
+    // Determine scheduling policy
+    if (config.policy == SHORTEST_JOB_FIRST) {
+        serverLogger.log("Using Shortest Job First scheduling");
+    } else if (config.policy == WORK_STEALING) {
+        serverLogger.log("Using Work Stealing scheduling");
+    } else {
+        serverLogger.log("Using Round Robin scheduling");
+    }
+    
+    threadPool = new ThreadPool(config.workerThreads, config.policy);
+    historyStore = new HistoryStore(config.historyDepth);
+    if (nodes > 1) {
+        groupManager.setIdSpacing(static_cast<uint16_t>(nodes), static_cast<uint16_t>(config.nodeIndex));
+    }
+    
+    contentFilter.setKernel(config.filterKernel);
+    if (!config.filterFile.empty()) {
+        size_t badLine;
+        if (!contentFilter.loadPatterns(config.filterFile, badLine)) {
+            std::cerr << "Cannot load content filter " << config.filterFile;
+            if (badLine) {
+                std::cerr << ": keyword on line " << badLine << " is over 64 bytes or past the "
+                          << ContentFilter::MAX_PATTERNS << "-keyword limit";
+            }
+            std::cerr << std::endl;
+            return -1;
+        }
+        serverLogger.log("Content filter loaded " + std::to_string(contentFilter.patternCount()) +
+                         " keywords from " + config.filterFile);
+    }
+    serverLogger.log(std::string("Payload scanning uses ") +
+                     ContentFilter::kernelName(contentFilter.getKernel()));
+    
+    if (config.persist) {
+        messageLog = new MessageLog(config.logOptions);
+        if (!messageLog->open()) {
+            std::cerr << "Cannot open message log in " << config.logOptions.directory << std::endl;
+            return -1;
+        }
+        messageLog->forEachRecoveredGroup(
+            [](uint16_t groupID, const std::string& name, uint32_t lastSequence) {
+                groupManager.restoreGroup(groupID, name, lastSequence);
+            });
+        for (const auto& group : groupManager.listGroups()) {
+            messageLog->recordGroup(group.first, group.second);
+        }
+        serverLogger.log("Message log opened in " + config.logOptions.directory);
+    }
+    
+    // Sharded mode: one SO_REUSEPORT listener and reactor per shard, each
+    // reactor on its own core
+    uint32_t shards = static_cast<uint32_t>(config.reactorThreads);
+    if (shards == 0) {
+        shards = std::max(1u, std::min(std::thread::hardware_concurrency(),
+                                       static_cast<unsigned>(MAX_REACTORS)));
+    }
+    
+    std::vector<int> listenFds;
+    for (uint32_t i = 0; i < shards; ++i) {
+        int fd = openListener(port, shards > 1);
+        if (fd < 0) {
+            return -1;
+        }
+        listenFds.push_back(fd);
+    }
     
     serverLogger.log("Server listening on port " + std::to_string(port));
     std::cout << "Chat server running on port " << port << std::endl;
     std::cout << "Press Ctrl+C to stop" << std::endl;
     
-    uint32_t clientCounter = 1;
+    std::atomic<uint32_t> clientCounter(1);
+    for (uint32_t i = 0; i < shards; ++i) {
+        Reactor* shard = createReactor(config.ioBackend, listenFds[i], clientCounter);
+        if (!shard) {
+            std::cerr << "Reactor initialization failed" << std::endl;
+            return -1;
+        }
+        shard->setShard(i, shards);
+        shard->setNode(config.nodeIndex, nodes);
+        shard->setSendBudget(config.sendBudget, config.slowPolicy);
+        shard->setIdleTimeout(static_cast<uint64_t>(config.idleTimeoutSec) * 1000);
+        shard->onConnect = [](const std::shared_ptr<Connection>& conn) {
+            connectionRegistry.add(conn);
+            serverLogger.log("New client connected", conn->clientID, conn->clientIP);
+        };
+        shard->onPacket = onClientPacket;
+        shard->onDisconnect = onClientDisconnect;
+        shard->attachMetrics(serverMetrics);
+        reactors[i] = shard;
+    }
+    reactors[0]->onNotify = []() {
+        std::cout << "=== Server Metrics ===\n" << serverMetrics.dump() << std::flush;
+    };
+    reactors[0]->onTick = [](uint64_t) {
+        messageCache.clearExpired();
+        sessionStore.sweep();
+        if (federation) {
+            federation->sweep();
+        }
+    };
+    messageRateLimit = config.rateLimit;
+    sessionsEnabled = config.sessionTtlSec > 0;
+    sessionStore.setTtl(static_cast<uint64_t>(config.sessionTtlSec) * 1000);
+    reactorCount.store(shards);
+    serverLogger.log(std::string("Event loop: ") + reactors[0]->getBackendName() +
+                     " x" + std::to_string(shards));
+    registerSampledMetrics();
     
-    while (true) {
-        int client_socket = accept(server_fd, (struct sockaddr*)&address, 
-                                   (socklen_t*)&addrlen);
-        
-        if (client_socket < 0) {
-            std::cerr << "Accept failed" << std::endl;
-            continue;
+    if (nodes > 1) {
+        federation = new Federation(config.nodeIndex, config.peers, groupManager);
+        federation->onForward = [](ChatPacket& packet) {
+            ChatGroup* group = groupManager.getGroup(packet.groupID);
+            if (group) {
+                publishMessage(group, packet);
+            }
+        };
+        federation->onDeliver = [](const ChatPacket& packet, uint32_t sequence) {
+            ChatGroup* group = groupManager.getGroup(packet.groupID);
+            if (!group) return;
+            // Track the owner's sequence so disconnect snapshots work here too
+            std::lock_guard<std::mutex> lock(group->publishMutex);
+            if (sequence > group->lastSequence) {
+                group->lastSequence = sequence;
+            }
+            broadcastToGroup(packet, packet.senderID, sequence);
+        };
+        federation->onHistoryRequest = [](uint16_t groupID, const HistoryCursor& cursor,
+                                          std::vector<HistoryEntry>& page) {
+            page = buildHistoryPage(groupID, cursor);
+        };
+        federation->onHistoryReply = [](uint32_t clientID, const std::vector<HistoryEntry>& page) {
+            // Messages oldest first, then the closing packet. A node with no
+            // members left stops receiving deliveries, so a replay may be the
+            // newest it has seen of the group.
+            if (page.empty()) return;
+            ChatGroup* group = groupManager.getGroup(page.back().packet.groupID);
+            if (group && page.size() > 1) {
+                std::lock_guard<std::mutex> lock(group->publishMutex);
+                group->lastSequence = std::max(group->lastSequence, page[page.size() - 2].sequence);
+            }
+            std::shared_ptr<Connection> conn = connectionRegistry.find(clientID);
+            if (conn) {
+                sendPackets(conn, page);
+            }
+        };
+        federation->attachMetrics(serverMetrics);
+        if (!config.peerSecretFile.empty() && !federation->loadSecret(config.peerSecretFile)) {
+            std::cerr << "Cannot read a peer secret from " << config.peerSecretFile << std::endl;
+            return -1;
         }
-        
-        uint32_t clientID = clientCounter++;
-        std::string clientIP = "client_ip"; // In real impl, extract from sockaddr
-        
-        // Enqueue client handling task
-        threadPool->enqueue([client_socket, clientID, clientIP]() {
-            handleClient(client_socket, clientID, clientIP);
-        }, 10, clientID);
+        if (!federation->start()) {
+            std::cerr << "Cannot resolve the peers or listen for them on "
+                      << config.peers[config.nodeIndex].host << ":" << config.peers[config.nodeIndex].port
+                      << std::endl;
+            return -1;
+        }
+        serverLogger.log("Federation: node " + std::to_string(config.nodeIndex) + " of " +
+                         std::to_string(nodes));
     }
     
-    delete threadPool;
-    close(server_fd);
+    if (config.mediaPort > 0) {
+        std::string mediaDir = config.mediaDir.empty() ? config.logOptions.directory + "/media"
+                                                       : config.mediaDir;
+        mediaServer = new MediaServer(config.mediaPort, mediaDir, config.mediaMaxBytes,
+                                      config.mediaQuotaBytes, config.mediaSenderBytes,
+                                      static_cast<uint64_t>(config.mediaKeepDays) * 86400000);
+        mediaServer->onComplete = announceMedia;
+        mediaServer->attachMetrics(serverMetrics);
+        if (!mediaServer->start()) {
+            std::cerr << "Cannot start media transfers on port " << config.mediaPort
+                      << " with spool directory " << mediaDir << std::endl;
+            return -1;
+        }
+        serverLogger.log("Media transfers on port " + std::to_string(config.mediaPort) +
+                         ", spooled in " + mediaDir);
+    }
+    
+    // Shard 0 runs on the main thread
+    std::vector<std::thread> reactorThreads;
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t i = 1; i < shards; ++i) {
+        reactorThreads.emplace_back([i]() { reactors[i]->run(); });
+        pinToCore(reactorThreads.back().native_handle(), i % cores);
+    }
+    if (shards > 1) {
+        pinToCore(pthread_self(), 0);
+    }
+    reactors[0]->run();
+    
+    for (uint32_t i = 0; i < shards; ++i) {
+        reactors[i]->stop();
+    }
+    for (auto& thread : reactorThreads) {
+        thread.join();
+    }
+    // Stop their threads, but keep the objects: queued pool tasks still
+    // call into them until the pool is drained below
+    if (federation) {
+        federation->stop();
+    }
+    if (mediaServer) {
+        mediaServer->stop();
+    }
+    
+    serverLogger.log("Interrupt signal received. Shutting down server...");
+    for (int fd : listenFds) {
+        close(fd);
+    }
     
-    // Print statistics
+    // Print statistics before the pool is torn down
     uint64_t processed, avgTime, hits, misses, evictions;
     threadPool->getStats(processed, avgTime);
     messageCache.getStats(hits, misses, evictions);
+    std::string metrics = serverMetrics.dump();  // samples the pool, reactors and media
+    
+    delete threadPool;
+    delete mediaServer;
+    mediaServer = nullptr;
+    delete federation;
+    federation = nullptr;
+    reactorCount.store(0);
+    for (uint32_t i = 0; i < shards; ++i) {
+        delete reactors[i];
+    }
+    delete messageLog;
+    delete historyStore;
+    serverLogger.stopAsync();
     
     std::cout << "\n=== Server Statistics ===" << std::endl;
     std::cout << "Tasks processed: " << processed << std::endl;
@@ -233,6 +1131,7 @@ int main(int argc, char* argv[]) {
     std::cout << "Cache hits: " << hits << std::endl;
     std::cout << "Cache misses: " << misses << std::endl;
     std::cout << "Cache evictions: " << evictions << std::endl;
+    std::cout << "\n=== Server Metrics ===\n" << metrics << std::flush;
     
     return 0;
 }
@@ -0,0 +1,719 @@
+#ifndef MEDIA_SERVER_H
+#define MEDIA_SERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../shared/metrics.h"
+#include "../shared/protocol.h"
+#include "../shared/timing_wheel.h"
+#include "../shared/utils.h"
+
+// Bytes moved per splice/sendfile call
+static const size_t MEDIA_CHUNK_BYTES = 1u << 20;
+
+// Transfers silent this long are closed; an upload keeps what it received
+static const uint64_t MEDIA_IDLE_TIMEOUT_MS = 30000;
+
+static const size_t MAX_MEDIA_TRANSFERS = 1024;
+
+// An unfinished upload nobody has written to for this long is deleted
+static const uint64_t MEDIA_UPLOAD_TTL_MS = 3600000;
+
+enum UploadResult {
+    UPLOAD_CREATED,
+    UPLOAD_OVER_QUOTA,    // the spool or the sender's share of it is full
+    UPLOAD_FAILED
+};
+
+// One uploaded (or uploading) media object
+struct MediaInfo {
+    uint32_t mediaID;
+    uint8_t kind;         // MSG_AUDIO or MSG_VIDEO
+    uint16_t groupID;
+    uint32_t senderID;
+    uint64_t key;
+    uint64_t size;
+    uint64_t received;    // bytes on disk; updated when an upload connection ends
+    bool complete;
+    bool uploading;       // a connection is streaming it right now
+    std::string name;
+};
+
+// Media transfers on their own port and event loop, so a voice note or a
+// video never sits in front of text in a connection's outbound queue or
+// keeps a worker busy. Each object is spooled to <directory>/<id>.media
+// behind a small header; uploads are spliced socket -> pipe -> file and
+// downloads sent with sendfile, so the bytes stay in the kernel. Both
+// directions resume from an offset, and spooled objects (complete or not)
+// are found again after a restart. Every object counts its full size
+// against a total and a per-sender quota from the moment it is offered;
+// uploads abandoned for MEDIA_UPLOAD_TTL_MS and complete objects older
+// than the retention period are deleted by an expiry wheel.
+class MediaServer {
+private:
+    static const uint64_t EXPIRY_TICK_MS = 1000;
+
+#pragma pack(push, 1)
+    struct SpoolHeader {
+        char magic[4];
+        uint8_t kind;
+        uint8_t complete;
+        uint16_t groupID;
+        uint32_t mediaID;
+        uint32_t senderID;
+        uint64_t key;
+        uint64_t size;
+    };
+#pragma pack(pop)
+
+    enum TransferState {
+        READ_REQUEST,
+        SEND_REPLY,
+        UPLOADING,
+        DOWNLOADING,
+        FINISHED
+    };
+
+    // A spooled object and its expiry timer
+    struct SpoolEntry {
+        std::shared_ptr<MediaInfo> info;
+        TimerNode expiry;
+
+        explicit SpoolEntry(const std::shared_ptr<MediaInfo>& object) : info(object), expiry(this) {}
+    };
+
+    struct Transfer {
+        int fd;
+        TransferState state;
+        TransferState afterReply;
+        char request[sizeof(MediaRequest)];
+        size_t requestBytes;
+        char reply[sizeof(MediaReply)];
+        size_t replySent;
+        std::shared_ptr<MediaInfo> media;
+        bool uploading;       // holds media->uploading
+        int fileFd;
+        uint64_t offset;      // next media byte to move
+        uint64_t lastActivity;
+
+        explicit Transfer(int socketFd)
+            : fd(socketFd), state(READ_REQUEST), afterReply(FINISHED), requestBytes(0),
+              replySent(sizeof(reply)), uploading(false), fileFd(-1), offset(0),
+              lastActivity(CoarseClock::nowMs()) {}
+    };
+
+    int port;
+    std::string directory;
+    uint64_t maxBytes;
+    uint64_t quotaBytes;
+    uint64_t senderQuotaBytes;
+    uint64_t keepMs;          // retention of complete objects, 0 = forever
+
+    // Guarded by mediaMutex
+    std::unordered_map<uint32_t, std::unique_ptr<SpoolEntry>> media;
+    uint32_t nextMediaID;
+    uint64_t spoolBytes;      // sizes of every object, uploaded or not
+    std::unordered_map<uint32_t, uint64_t> senderBytes;
+    TimingWheel expiryWheel;
+    std::mutex mediaMutex;
+
+    // Owned by the loop thread
+    std::unordered_map<int, std::unique_ptr<Transfer>> transfers;
+    int listenFd;
+    int epollFd;
+    int wakeFd;
+    int pipeFds[2];
+    bool useSplice;
+    std::atomic<bool> running;
+    std::atomic<size_t> activeTransfers;
+    std::thread loopThread;
+
+    Counter* uploadedBytes;
+    Counter* sentBytes;
+    Counter* uploadsCompleted;
+    Counter* downloadsCut;
+    Counter* expiredObjects;
+
+    std::string spoolPath(uint32_t mediaID) const {
+        return directory + "/" + std::to_string(mediaID) + ".media";
+    }
+
+    // Caller holds mediaMutex
+    SpoolEntry& addObject(const std::shared_ptr<MediaInfo>& object) {
+        std::unique_ptr<SpoolEntry>& entry = media[object->mediaID];
+        entry.reset(new SpoolEntry(object));
+        spoolBytes += object->size;
+        senderBytes[object->senderID] += object->size;
+        return *entry;
+    }
+
+    // Caller holds mediaMutex
+    void removeObject(uint32_t mediaID) {
+        auto it = media.find(mediaID);
+        if (it == media.end()) return;
+        const MediaInfo& object = *it->second->info;
+        expiryWheel.cancel(&it->second->expiry);
+        spoolBytes -= object.size;
+        auto sender = senderBytes.find(object.senderID);
+        sender->second -= object.size;
+        if (sender->second == 0) senderBytes.erase(sender);
+        media.erase(it);
+    }
+
+    // (Re)arm an object's expiry: an upload's TTL or a complete object's
+    // retention, less ageMs already spent in that state. Caller holds
+    // mediaMutex.
+    void scheduleExpiry(SpoolEntry& entry, uint64_t ageMs) {
+        uint64_t lifetime = entry.info->complete ? keepMs : MEDIA_UPLOAD_TTL_MS;
+        if (lifetime == 0) {
+            expiryWheel.cancel(&entry.expiry);
+            return;
+        }
+        uint64_t left = ageMs < lifetime ? lifetime - ageMs : 0;
+        expiryWheel.schedule(&entry.expiry, CoarseClock::nowMs() + left);
+    }
+
+    // Reschedule once an upload connection is done with the object
+    void touchObject(uint32_t mediaID) {
+        std::lock_guard<std::mutex> lock(mediaMutex);
+        auto it = media.find(mediaID);
+        if (it != media.end()) scheduleExpiry(*it->second, 0);
+    }
+
+    // Delete whatever has expired. An upload still streaming gets a
+    // fresh TTL; a download already running keeps its open file.
+    void expireSpool() {
+        std::vector<uint32_t> expired;
+        {
+            std::lock_guard<std::mutex> lock(mediaMutex);
+            expiryWheel.advance(CoarseClock::nowMs(), [this, &expired](TimerNode* timer) {
+                SpoolEntry* entry = static_cast<SpoolEntry*>(timer->owner);
+                if (entry->info->uploading) {
+                    scheduleExpiry(*entry, 0);
+                } else {
+                    expired.push_back(entry->info->mediaID);
+                }
+            });
+            for (uint32_t mediaID : expired) {
+                removeObject(mediaID);
+            }
+        }
+        for (uint32_t mediaID : expired) {
+            unlink(spoolPath(mediaID).c_str());
+            if (expiredObjects) expiredObjects->add();
+        }
+    }
+
+    // Rebuild the table from the spool directory. Expiry resumes from each
+    // file's last write.
+    void recover() {
+        time_t now = time(nullptr);
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) return;
+        while (struct dirent* entry = readdir(dir)) {
+            std::string file = entry->d_name;
+            if (file.size() <= 6 || file.compare(file.size() - 6, 6, ".media") != 0) continue;
+            std::string path = directory + "/" + file;
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) continue;
+            SpoolHeader header;
+            struct stat info;
+            bool valid = pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+                         memcmp(header.magic, "GCM1", 4) == 0 && fstat(fd, &info) == 0;
+            close(fd);
+            if (!valid || media.count(header.mediaID)) continue;
+
+            std::shared_ptr<MediaInfo> object = std::make_shared<MediaInfo>();
+            object->mediaID = header.mediaID;
+            object->kind = header.kind;
+            object->groupID = header.groupID;
+            object->senderID = header.senderID;
+            object->key = header.key;
+            object->size = header.size;
+            object->received = std::min<uint64_t>(header.size, static_cast<uint64_t>(info.st_size) - sizeof(header));
+            object->complete = header.complete != 0;
+            object->uploading = false;
+            uint64_t ageMs = now > info.st_mtime ? static_cast<uint64_t>(now - info.st_mtime) * 1000 : 0;
+            scheduleExpiry(addObject(object), ageMs);
+            nextMediaID = std::max(nextMediaID, object->mediaID + 1);
+        }
+        closedir(dir);
+    }
+
+    void setReply(Transfer& transfer, MediaStatus status, uint64_t offset, uint64_t size,
+                  TransferState next) {
+        MediaReply reply;
+        reply.status = status;
+        reply.offset = offset;
+        reply.size = size;
+        writeMediaReply(transfer.reply, reply);
+        transfer.replySent = 0;
+        transfer.state = SEND_REPLY;
+        transfer.afterReply = next;
+        watch(transfer, EPOLLOUT);
+    }
+
+    void watch(Transfer& transfer, uint32_t events) {
+        struct epoll_event event;
+        event.events = events;
+        event.data.fd = transfer.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, transfer.fd, &event);
+    }
+
+    // A complete request arrived: look the object up and queue the reply
+    void beginTransfer(Transfer& transfer) {
+        MediaRequest request;
+        readMediaRequest(transfer.request, request);
+
+        std::shared_ptr<MediaInfo> object;
+        {
+            std::lock_guard<std::mutex> lock(mediaMutex);
+            auto it = media.find(request.mediaID);
+            if (it != media.end() && it->second->info->key == request.key) {
+                object = it->second->info;
+            }
+        }
+        if (!object || (request.op != MEDIA_UPLOAD && request.op != MEDIA_DOWNLOAD)) {
+            setReply(transfer, MEDIA_UNKNOWN, 0, 0, FINISHED);
+            return;
+        }
+
+        if (request.op == MEDIA_UPLOAD) {
+            {
+                std::lock_guard<std::mutex> lock(mediaMutex);
+                if (object->complete) {
+                    setReply(transfer, MEDIA_OK, object->size, object->size, FINISHED);
+                    return;
+                }
+                if (object->uploading) {
+                    setReply(transfer, MEDIA_BUSY, object->received, object->size, FINISHED);
+                    return;
+                }
+                object->uploading = true;
+                transfer.offset = object->received;
+            }
+            transfer.media = object;
+            transfer.uploading = true;
+            transfer.fileFd = open(spoolPath(object->mediaID).c_str(), O_WRONLY | O_CLOEXEC);
+            if (transfer.fileFd < 0) {
+                setReply(transfer, MEDIA_FAILED, 0, object->size, FINISHED);
+                return;
+            }
+            setReply(transfer, MEDIA_OK, transfer.offset, object->size, UPLOADING);
+            return;
+        }
+
+        bool complete;
+        {
+            std::lock_guard<std::mutex> lock(mediaMutex);
+            complete = object->complete;
+        }
+        if (!complete) {
+            setReply(transfer, MEDIA_NOT_READY, 0, object->size, FINISHED);
+            return;
+        }
+        if (request.offset > object->size) {
+            setReply(transfer, MEDIA_BAD_OFFSET, request.offset, object->size, FINISHED);
+            return;
+        }
+        transfer.fileFd = open(spoolPath(object->mediaID).c_str(), O_RDONLY | O_CLOEXEC);
+        if (transfer.fileFd < 0) {
+            setReply(transfer, MEDIA_FAILED, 0, object->size, FINISHED);
+            return;
+        }
+        transfer.media = object;
+        transfer.offset = request.offset;
+        setReply(transfer, MEDIA_OK, transfer.offset, object->size, DOWNLOADING);
+    }
+
+    // Throw away bytes left in the shared pipe by a failed drain, so they
+    // never land in the next upload's file. If even that fails, stop using
+    // the pipe.
+    void discardPipe(size_t left) {
+        char buffer[64 * 1024];
+        while (left > 0) {
+            ssize_t got = read(pipeFds[0], buffer, std::min(left, sizeof(buffer)));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+            left -= static_cast<size_t>(got);
+        }
+        if (left > 0) useSplice = false;
+    }
+
+    // Move what the socket holds into the spool file. Returns false once
+    // the transfer should be closed.
+    bool pumpUpload(Transfer& transfer) {
+        uint64_t size = transfer.media->size;
+        while (transfer.offset < size) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(size - transfer.offset, MEDIA_CHUNK_BYTES));
+            loff_t fileOffset = static_cast<loff_t>(sizeof(SpoolHeader) + transfer.offset);
+            ssize_t moved;
+            if (useSplice) {
+                moved = splice(transfer.fd, nullptr, pipeFds[1], nullptr, want,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (moved < 0 && errno == EINVAL) {
+                    useSplice = false;
+                    continue;
+                }
+                // Drain the pipe completely so it is empty for the next transfer
+                for (ssize_t left = moved; left > 0;) {
+                    ssize_t written = splice(pipeFds[0], nullptr, transfer.fileFd, &fileOffset,
+                                             static_cast<size_t>(left), SPLICE_F_MOVE);
+                    if (written < 0 && errno == EINTR) continue;
+                    if (written <= 0) {
+                        discardPipe(static_cast<size_t>(left));
+                        return false;
+                    }
+                    left -= written;
+                }
+            } else {
+                char buffer[64 * 1024];
+                moved = recv(transfer.fd, buffer, std::min(want, sizeof(buffer)), 0);
+                if (moved > 0 && pwrite(transfer.fileFd, buffer, static_cast<size_t>(moved), fileOffset) != moved) {
+                    return false;
+                }
+            }
+            if (moved == 0) return false;
+            if (moved < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            transfer.offset += static_cast<uint64_t>(moved);
+            if (uploadedBytes) uploadedBytes->add(static_cast<uint64_t>(moved));
+        }
+        return finishUpload(transfer);
+    }
+
+    // Every byte is in: mark the spool complete and confirm to the client
+    bool finishUpload(Transfer& transfer) {
+        MediaInfo& object = *transfer.media;
+        uint8_t complete = 1;
+        if (pwrite(transfer.fileFd, &complete, sizeof(complete), offsetof(SpoolHeader, complete)) != 1 ||
+            fdatasync(transfer.fileFd) != 0) {
+            return false;
+        }
+        close(transfer.fileFd);
+        transfer.fileFd = -1;
+
+        MediaInfo snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mediaMutex);
+            object.received = object.size;
+            object.complete = true;
+            object.uploading = false;
+            snapshot = object;
+            auto it = media.find(object.mediaID);
+            if (it != media.end()) scheduleExpiry(*it->second, 0);
+        }
+        transfer.uploading = false;
+        transfer.media.reset();
+        if (uploadsCompleted) uploadsCompleted->add();
+        if (onComplete) onComplete(snapshot);
+
+        setReply(transfer, MEDIA_OK, snapshot.size, snapshot.size, FINISHED);
+        return true;
+    }
+
+    // Send the file straight from the page cache. Returns false once the
+    // transfer should be closed.
+    bool pumpDownload(Transfer& transfer) {
+        uint64_t size = transfer.media->size;
+        while (transfer.offset < size) {
+            size_t want = static_cast<size_t>(std::min<uint64_t>(size - transfer.offset, MEDIA_CHUNK_BYTES));
+            off_t fileOffset = static_cast<off_t>(sizeof(SpoolHeader) + transfer.offset);
+            ssize_t sent = sendfile(transfer.fd, transfer.fileFd, &fileOffset, want);
+            if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            if (sent == 0) return false;
+            transfer.offset += static_cast<uint64_t>(sent);
+            if (sentBytes) sentBytes->add(static_cast<uint64_t>(sent));
+        }
+        return false;
+    }
+
+    // Returns false once the transfer should be closed
+    bool handle(Transfer& transfer, uint32_t events) {
+        transfer.lastActivity = CoarseClock::nowMs();
+        if (events & EPOLLERR) return false;
+
+        if (transfer.state == READ_REQUEST) {
+            ssize_t received = recv(transfer.fd, transfer.request + transfer.requestBytes,
+                                    sizeof(transfer.request) - transfer.requestBytes, 0);
+            if (received == 0) return false;
+            if (received < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            transfer.requestBytes += static_cast<size_t>(received);
+            if (transfer.requestBytes < sizeof(transfer.request)) return true;
+            beginTransfer(transfer);
+        }
+
+        if (transfer.state == SEND_REPLY) {
+            while (transfer.replySent < sizeof(transfer.reply)) {
+                ssize_t sent = send(transfer.fd, transfer.reply + transfer.replySent,
+                                    sizeof(transfer.reply) - transfer.replySent, MSG_NOSIGNAL);
+                if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                transfer.replySent += static_cast<size_t>(sent);
+            }
+            transfer.state = transfer.afterReply;
+            if (transfer.state == UPLOADING) {
+                watch(transfer, EPOLLIN | EPOLLRDHUP);
+            }
+        }
+
+        if (transfer.state == UPLOADING) return pumpUpload(transfer);
+        if (transfer.state == DOWNLOADING) return pumpDownload(transfer);
+        return transfer.state != FINISHED;
+    }
+
+    void closeTransfer(int fd) {
+        auto it = transfers.find(fd);
+        if (it == transfers.end()) return;
+        Transfer& transfer = *it->second;
+        if (transfer.uploading) {
+            {
+                std::lock_guard<std::mutex> lock(mediaMutex);
+                transfer.media->received = transfer.offset;
+                transfer.media->uploading = false;
+            }
+            touchObject(transfer.media->mediaID);
+        } else if (transfer.state == DOWNLOADING && transfer.offset < transfer.media->size) {
+            if (downloadsCut) downloadsCut->add();
+        }
+        if (transfer.fileFd >= 0) close(transfer.fileFd);
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        transfers.erase(it);
+        activeTransfers.store(transfers.size());
+    }
+
+    void acceptTransfers() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            if (transfers.size() >= MAX_MEDIA_TRANSFERS) {
+                close(fd);
+                continue;
+            }
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            transfers[fd].reset(new Transfer(fd));
+            activeTransfers.store(transfers.size());
+        }
+    }
+
+    void closeIdle() {
+        uint64_t now = CoarseClock::nowMs();
+        std::vector<int> idle;
+        for (const auto& entry : transfers) {
+            if (now - entry.second->lastActivity > MEDIA_IDLE_TIMEOUT_MS) {
+                idle.push_back(entry.first);
+            }
+        }
+        for (int fd : idle) {
+            closeTransfer(fd);
+        }
+    }
+
+    void run() {
+        struct epoll_event events[64];
+        while (running.load()) {
+            int count = epoll_wait(epollFd, events, 64, 1000);
+            for (int i = 0; i < count; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptTransfers();
+                } else if (fd != wakeFd) {
+                    auto it = transfers.find(fd);
+                    if (it != transfers.end() && !handle(*it->second, events[i].events)) {
+                        closeTransfer(fd);
+                    }
+                }
+            }
+            closeIdle();
+            expireSpool();
+        }
+        std::vector<int> remaining;
+        for (const auto& entry : transfers) {
+            remaining.push_back(entry.first);
+        }
+        for (int fd : remaining) {
+            closeTransfer(fd);
+        }
+    }
+
+public:
+    // Runs on the media thread once an upload is complete and durable
+    std::function<void(const MediaInfo&)> onComplete;
+
+    MediaServer(int mediaPort, const std::string& spoolDirectory, uint64_t maxObjectBytes,
+                uint64_t spoolQuotaBytes, uint64_t senderQuota, uint64_t keepMilliseconds)
+        : port(mediaPort), directory(spoolDirectory), maxBytes(maxObjectBytes),
+          quotaBytes(spoolQuotaBytes), senderQuotaBytes(senderQuota), keepMs(keepMilliseconds),
+          nextMediaID(1), spoolBytes(0), expiryWheel(EXPIRY_TICK_MS, CoarseClock::nowMs()),
+          listenFd(-1), epollFd(-1), wakeFd(-1), useSplice(true),
+          running(false), activeTransfers(0), uploadedBytes(nullptr), sentBytes(nullptr),
+          uploadsCompleted(nullptr), downloadsCut(nullptr), expiredObjects(nullptr) {
+        pipeFds[0] = pipeFds[1] = -1;
+    }
+
+    ~MediaServer() {
+        stop();
+    }
+
+    MediaServer(const MediaServer&) = delete;
+    MediaServer& operator=(const MediaServer&) = delete;
+
+    void attachMetrics(MetricsRegistry& registry) {
+        uploadedBytes = &registry.counter("media.uploaded_bytes");
+        sentBytes = &registry.counter("media.sent_bytes");
+        uploadsCompleted = &registry.counter("media.uploads");
+        downloadsCut = &registry.counter("media.downloads_cut");
+        expiredObjects = &registry.counter("media.expired");
+        registry.sampled("media.transfers", [this]() {
+            return static_cast<int64_t>(activeTransfers.load());
+        });
+        registry.sampled("media.spool_bytes", [this]() {
+            std::lock_guard<std::mutex> lock(mediaMutex);
+            return static_cast<int64_t>(spoolBytes);
+        });
+    }
+
+    // Recover the spool and start listening for media connections
+    bool start() {
+        size_t slash = directory.rfind('/');
+        if (slash != std::string::npos && slash > 0) {
+            mkdir(directory.substr(0, slash).c_str(), 0755);
+        }
+        mkdir(directory.c_str(), 0755);
+        if (access(directory.c_str(), W_OK) != 0) return false;
+        recover();
+
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) return false;
+        int on = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        if (bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 ||
+            listen(listenFd, SOMAXCONN) < 0) {
+            return false;
+        }
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0 || pipe2(pipeFds, O_CLOEXEC) < 0) return false;
+        fcntl(pipeFds[1], F_SETPIPE_SZ, static_cast<int>(MEDIA_CHUNK_BYTES));
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+        event.data.fd = wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+        running.store(true);
+        loopThread = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop() {
+        if (running.exchange(false)) {
+            uint64_t one = 1;
+            ssize_t ignored = write(wakeFd, &one, sizeof(one));
+            (void)ignored;
+            loopThread.join();
+        }
+        for (int* fd : {&listenFd, &epollFd, &wakeFd, &pipeFds[0], &pipeFds[1]}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+    // Reserve a media ID and spool file for an offered upload. Fails for
+    // an empty or oversized object, one that would take the spool or the
+    // sender past its quota, or if the spool file cannot be created.
+    UploadResult createUpload(uint8_t kind, uint16_t groupID, uint32_t senderID, uint64_t size,
+                              const std::string& name, MediaDescriptor& ticket) {
+        if (size == 0 || size > maxBytes) return UPLOAD_FAILED;
+
+        std::shared_ptr<MediaInfo> object = std::make_shared<MediaInfo>();
+        object->kind = kind;
+        object->groupID = groupID;
+        object->senderID = senderID;
+        object->size = size;
+        object->received = 0;
+        object->complete = false;
+        object->uploading = false;
+        object->name = name;
+
+        std::lock_guard<std::mutex> lock(mediaMutex);
+        auto sender = senderBytes.find(senderID);
+        uint64_t senderUsed = sender != senderBytes.end() ? sender->second : 0;
+        if (size > quotaBytes - std::min(spoolBytes, quotaBytes) ||
+            size > senderQuotaBytes - std::min(senderUsed, senderQuotaBytes)) {
+            return UPLOAD_OVER_QUOTA;
+        }
+        object->mediaID = nextMediaID;
+        // The key is the only credential for the object
+        secureRandom(&object->key, sizeof(object->key));
+
+        SpoolHeader header;
+        memcpy(header.magic, "GCM1", 4);
+        header.kind = kind;
+        header.complete = 0;
+        header.groupID = groupID;
+        header.mediaID = object->mediaID;
+        header.senderID = senderID;
+        header.key = object->key;
+        header.size = size;
+        int fd = open(spoolPath(object->mediaID).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return UPLOAD_FAILED;
+        bool written = write(fd, &header, sizeof(header)) == static_cast<ssize_t>(sizeof(header));
+        close(fd);
+        if (!written) {
+            unlink(spoolPath(object->mediaID).c_str());
+            return UPLOAD_FAILED;
+        }
+
+        ++nextMediaID;
+        scheduleExpiry(addObject(object), 0);
+        ticket.mediaID = object->mediaID;
+        ticket.key = object->key;
+        ticket.size = size;
+        ticket.port = static_cast<uint16_t>(port);
+        return UPLOAD_CREATED;
+    }
+
+    int getPort() const {
+        return port;
+    }
+
+    uint64_t getMaxBytes() const {
+        return maxBytes;
+    }
+};
+
+#endif // MEDIA_SERVER_H
@@ -0,0 +1,627 @@
+#ifndef MESSAGE_LOG_H
+#define MESSAGE_LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../shared/protocol.h"
+#include "../shared/frame.h"
+#include "../shared/history_store.h"
+
+struct MessageLogOptions {
+    std::string directory;
+    uint64_t segmentBytes;     // rotate once the active segment reaches this size
+    uint32_t indexEntries;     // index slots per segment (also forces rotation)
+    uint32_t retainSegments;   // sealed + active segments kept per group
+    uint32_t commitIntervalMs; // longest a record waits for group commit
+
+    MessageLogOptions()
+        : directory("../data"), segmentBytes(64u << 20), indexEntries(1u << 20),
+          retainSegments(8), commitIntervalMs(5) {}
+};
+
+// On-disk record: this header followed by the message as a v2 frame
+struct LogRecordHeader {
+    uint32_t length;   // frame bytes after this header
+    uint32_t sequence;
+    uint32_t checksum; // CRC-32 of the frame bytes
+};
+
+// Index slot, one per record. Slots are filled in sequence order and an
+// unused slot has sequence 0, which the server never assigns.
+struct LogIndexEntry {
+    uint32_t sequence;
+    uint32_t offset;
+};
+
+inline uint32_t crc32(const char* data, size_t length) {
+    static uint32_t table[256];
+    static bool initialized = [] {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)initialized;
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// One segment: an append-only .log file and a fixed-size .idx file that is
+// memory-mapped, so lookups are a binary search over mapped memory.
+class LogSegment {
+private:
+    int logFd;
+    int indexFd;
+    LogIndexEntry* index;
+
+    bool readRecord(uint32_t offset, HistoryEntry* out) const {
+        LogRecordHeader header;
+        if (offset + sizeof(header) > logSize) return false;
+        if (pread(logFd, &header, sizeof(header), offset) != sizeof(header)) return false;
+        if (header.length < PACKET_HEADER_SIZE || header.length > sizeof(ChatPacket)) return false;
+        if (offset + sizeof(header) + header.length > logSize) return false;
+
+        char frame[sizeof(ChatPacket)];
+        if (pread(logFd, frame, header.length, offset + sizeof(header)) !=
+            static_cast<ssize_t>(header.length)) {
+            return false;
+        }
+        if (crc32(frame, header.length) != header.checksum) return false;
+
+        if (out) {
+            ChatPacket packet;
+            if (decodeFrame(frame, header.length, WIRE_V2, packet) <= 0) return false;
+            *out = HistoryEntry(header.sequence, packet);
+        }
+        return true;
+    }
+
+public:
+    uint32_t firstSequence;
+    std::string basePath; // without extension
+    uint32_t indexCapacity;
+    uint32_t entryCount;
+    uint64_t logSize;
+
+    LogSegment(const std::string& dir, uint32_t firstSeq, uint32_t capacity)
+        : logFd(-1), indexFd(-1), index(nullptr), firstSequence(firstSeq),
+          indexCapacity(capacity), entryCount(0), logSize(0) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%010u", firstSeq);
+        basePath = dir + name;
+    }
+
+    ~LogSegment() {
+        close();
+    }
+
+    bool open() {
+        logFd = ::open((basePath + ".log").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        indexFd = ::open((basePath + ".idx").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (logFd < 0 || indexFd < 0) return false;
+
+        struct stat st;
+        if (fstat(indexFd, &st) < 0) return false;
+        size_t indexBytes = static_cast<size_t>(indexCapacity) * sizeof(LogIndexEntry);
+        if (static_cast<size_t>(st.st_size) != indexBytes) {
+            if (st.st_size > 0) {
+                indexCapacity = static_cast<uint32_t>(st.st_size / sizeof(LogIndexEntry));
+                indexBytes = static_cast<size_t>(indexCapacity) * sizeof(LogIndexEntry);
+            } else if (ftruncate(indexFd, indexBytes) < 0) {
+                return false;
+            }
+        }
+
+        void* mapped = mmap(nullptr, indexBytes, PROT_READ | PROT_WRITE, MAP_SHARED, indexFd, 0);
+        if (mapped == MAP_FAILED) return false;
+        index = static_cast<LogIndexEntry*>(mapped);
+
+        if (fstat(logFd, &st) < 0) return false;
+        logSize = static_cast<uint64_t>(st.st_size);
+
+        // Filled slots form a prefix; find its end by binary search
+        uint32_t lo = 0, hi = indexCapacity;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (index[mid].sequence != 0) lo = mid + 1; else hi = mid;
+        }
+        entryCount = lo;
+        return true;
+    }
+
+    // Make index and log agree after a crash. The index may run ahead of
+    // the log (mapped pages written back first) or behind it (records
+    // written but not yet indexed), and the log may end in a torn record.
+    // Dirty index pages can also reach disk out of order, so the filled
+    // prefix is found by a scan rather than open()'s binary search.
+    void recover() {
+        uint32_t filled = 0;
+        while (filled < indexCapacity && index[filled].sequence != 0) {
+            filled++;
+        }
+        for (uint32_t i = filled; i < entryCount; ++i) {
+            index[i].sequence = 0;
+        }
+        entryCount = filled;
+
+        while (entryCount > 0 && !readRecord(index[entryCount - 1].offset, nullptr)) {
+            index[--entryCount].sequence = 0;
+        }
+
+        uint64_t validEnd = 0;
+        uint32_t lastSequence = firstSequence - 1;
+        if (entryCount > 0) {
+            LogRecordHeader header;
+            uint32_t offset = index[entryCount - 1].offset;
+            if (pread(logFd, &header, sizeof(header), offset) == sizeof(header)) {
+                validEnd = offset + sizeof(header) + header.length;
+                lastSequence = header.sequence;
+            }
+        }
+
+        // Re-index intact records past the last indexed one
+        while (validEnd < logSize && entryCount < indexCapacity) {
+            HistoryEntry entry(0, ChatPacket());
+            uint32_t offset = static_cast<uint32_t>(validEnd);
+            if (!readRecord(offset, &entry) || entry.sequence <= lastSequence) break;
+
+            LogRecordHeader header;
+            if (pread(logFd, &header, sizeof(header), offset) != sizeof(header)) break;
+            index[entryCount].offset = offset;
+            index[entryCount].sequence = entry.sequence;
+            entryCount++;
+            lastSequence = entry.sequence;
+            validEnd = offset + sizeof(header) + header.length;
+        }
+
+        if (validEnd < logSize && ftruncate(logFd, validEnd) == 0) {
+            logSize = validEnd;
+        }
+    }
+
+    void close() {
+        if (index) {
+            munmap(index, static_cast<size_t>(indexCapacity) * sizeof(LogIndexEntry));
+            index = nullptr;
+        }
+        if (logFd >= 0) { ::close(logFd); logFd = -1; }
+        if (indexFd >= 0) { ::close(indexFd); indexFd = -1; }
+    }
+
+    void remove() {
+        close();
+        unlink((basePath + ".log").c_str());
+        unlink((basePath + ".idx").c_str());
+    }
+
+    bool isFull(uint64_t segmentBytes) const {
+        return logSize >= segmentBytes || entryCount >= indexCapacity;
+    }
+
+    uint32_t lastSequence() const {
+        return entryCount > 0 ? index[entryCount - 1].sequence : 0;
+    }
+
+    // Append already-encoded records in one write, then index them. On
+    // failure a partial write is cut off so later offsets stay right.
+    bool appendBatch(const std::string& bytes, const std::vector<LogIndexEntry>& entries) {
+        const char* data = bytes.data();
+        size_t remaining = bytes.size();
+        while (remaining > 0) {
+            ssize_t written = write(logFd, data, remaining);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (remaining < bytes.size() && ftruncate(logFd, logSize) != 0) {
+                    logSize += bytes.size() - remaining;  // keep offsets past the stray bytes
+                }
+                return false;
+            }
+            data += written;
+            remaining -= written;
+        }
+        for (const auto& entry : entries) {
+            index[entryCount++] = entry;
+        }
+        logSize += bytes.size();
+        return true;
+    }
+
+    // Log and index both: recovery only re-checks the tail segment
+    void sync() {
+        fdatasync(logFd);
+        if (entryCount > 0) {
+            msync(index, static_cast<size_t>(entryCount) * sizeof(LogIndexEntry), MS_SYNC);
+        }
+    }
+
+    // Index position of the first entry with sequence >= target
+    uint32_t lowerBound(uint32_t target) const {
+        const LogIndexEntry* begin = index;
+        const LogIndexEntry* it = std::lower_bound(begin, begin + entryCount, target,
+            [](const LogIndexEntry& e, uint32_t seq) { return e.sequence < seq; });
+        return static_cast<uint32_t>(it - begin);
+    }
+
+    bool readAt(uint32_t position, HistoryEntry& out) const {
+        return position < entryCount && readRecord(index[position].offset, &out);
+    }
+};
+
+// All segments of one group, oldest first; the last one is active
+struct GroupLog {
+    std::string directory;
+    std::vector<std::unique_ptr<LogSegment>> segments;
+    std::mutex logMutex;
+    uint32_t lastSequence;
+
+    GroupLog() : lastSequence(0) {}
+};
+
+// Durable per-group message log. Appends are queued and written by one
+// thread that batches everything pending into one write per segment and
+// one fdatasync per touched file (group commit). History reads that miss
+// the in-memory rings and the message cache are served from here.
+class MessageLog {
+private:
+    struct PendingRecord {
+        uint16_t groupID;
+        uint32_t sequence;
+        FramePtr frame;
+    };
+
+    MessageLogOptions options;
+    std::unordered_map<uint16_t, std::unique_ptr<GroupLog>> groups;
+    std::unordered_map<uint16_t, std::string> groupNames;
+    std::mutex groupsMutex;
+
+    std::vector<PendingRecord> pending;
+    std::mutex pendingMutex;
+    std::condition_variable pendingCondition;
+    std::thread writerThread;
+    bool stopping;
+
+    std::atomic<uint64_t> recordsWritten;
+    std::atomic<uint64_t> recordsFailed;
+    std::atomic<uint64_t> commits;
+
+    std::string groupDirectory(uint16_t groupID) const {
+        return options.directory + "/group_" + std::to_string(groupID);
+    }
+
+    GroupLog* findGroup(uint16_t groupID) {
+        std::lock_guard<std::mutex> lock(groupsMutex);
+        auto it = groups.find(groupID);
+        return (it != groups.end()) ? it->second.get() : nullptr;
+    }
+
+    GroupLog* findOrCreateGroup(uint16_t groupID) {
+        std::lock_guard<std::mutex> lock(groupsMutex);
+        auto& slot = groups[groupID];
+        if (!slot) {
+            slot.reset(new GroupLog());
+            slot->directory = groupDirectory(groupID);
+            mkdir(slot->directory.c_str(), 0755);
+        }
+        return slot.get();
+    }
+
+    // Caller holds the group's logMutex
+    LogSegment* activeSegment(GroupLog& group, uint32_t nextSequence) {
+        if (!group.segments.empty() && !group.segments.back()->isFull(options.segmentBytes)) {
+            return group.segments.back().get();
+        }
+
+        if (!group.segments.empty()) {
+            group.segments.back()->sync();
+        }
+        std::unique_ptr<LogSegment> segment(
+            new LogSegment(group.directory, nextSequence, options.indexEntries));
+        if (!segment->open()) return nullptr;
+        group.segments.push_back(std::move(segment));
+
+        // Retention: drop the oldest sealed segments
+        while (group.segments.size() > options.retainSegments) {
+            group.segments.front()->remove();
+            group.segments.erase(group.segments.begin());
+        }
+        return group.segments.back().get();
+    }
+
+    void commit(std::vector<PendingRecord>& batch) {
+        std::unordered_set<LogSegment*> touched;
+        size_t i = 0;
+
+        while (i < batch.size()) {
+            uint16_t groupID = batch[i].groupID;
+            GroupLog* group = findOrCreateGroup(groupID);
+            std::lock_guard<std::mutex> lock(group->logMutex);
+
+            LogSegment* segment = activeSegment(*group, batch[i].sequence);
+            if (!segment) {
+                recordsFailed++;
+                ++i;
+                continue;
+            }
+
+            // Consecutive records for this group that fit the active segment
+            std::string bytes;
+            std::vector<LogIndexEntry> entries;
+            uint64_t offset = segment->logSize;
+            while (i < batch.size() && batch[i].groupID == groupID &&
+                   offset < options.segmentBytes &&
+                   segment->entryCount + entries.size() < segment->indexCapacity) {
+                const PendingRecord& record = batch[i];
+                LogRecordHeader header;
+                header.length = static_cast<uint32_t>(record.frame->size());
+                header.sequence = record.sequence;
+                header.checksum = crc32(record.frame->data(), record.frame->size());
+
+                LogIndexEntry entry;
+                entry.sequence = record.sequence;
+                entry.offset = static_cast<uint32_t>(offset);
+                entries.push_back(entry);
+
+                bytes.append(reinterpret_cast<const char*>(&header), sizeof(header));
+                bytes.append(record.frame->data(), record.frame->size());
+                offset += sizeof(header) + record.frame->size();
+                ++i;
+            }
+
+            // lastSequence only covers what reached the file
+            if (segment->appendBatch(bytes, entries)) {
+                touched.insert(segment);
+                group->lastSequence = entries.back().sequence;
+                recordsWritten += entries.size();
+            } else {
+                recordsFailed += entries.size();
+            }
+        }
+
+        for (LogSegment* segment : touched) {
+            segment->sync();
+        }
+        commits++;
+    }
+
+    void writerLoop() {
+        std::vector<PendingRecord> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(pendingMutex);
+                pendingCondition.wait(lock, [this] { return stopping || !pending.empty(); });
+                if (pending.empty() && stopping) return;
+
+                // Let a burst accumulate so it shares one fdatasync
+                if (!stopping) {
+                    pendingCondition.wait_for(lock,
+                        std::chrono::milliseconds(options.commitIntervalMs),
+                        [this] { return stopping; });
+                }
+                batch.swap(pending);
+            }
+
+            // Group by group ID, keeping each group's sequence order
+            std::stable_sort(batch.begin(), batch.end(),
+                [](const PendingRecord& a, const PendingRecord& b) { return a.groupID < b.groupID; });
+            commit(batch);
+            batch.clear();
+        }
+    }
+
+    void recoverGroup(uint16_t groupID, const std::string& directory) {
+        std::vector<uint32_t> firstSequences;
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) return;
+        while (struct dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() == 14 && name.compare(10, 4, ".log") == 0) {
+                firstSequences.push_back(static_cast<uint32_t>(strtoul(name.c_str(), nullptr, 10)));
+            }
+        }
+        closedir(dir);
+        std::sort(firstSequences.begin(), firstSequences.end());
+
+        GroupLog* group = findOrCreateGroup(groupID);
+        std::lock_guard<std::mutex> lock(group->logMutex);
+        for (uint32_t first : firstSequences) {
+            std::unique_ptr<LogSegment> segment(
+                new LogSegment(directory, first, options.indexEntries));
+            if (segment->open()) {
+                group->segments.push_back(std::move(segment));
+            }
+        }
+
+        // Sealed segments (log and index) were synced at rotation; only the
+        // tail needs checking
+        if (!group->segments.empty()) {
+            group->segments.back()->recover();
+            for (auto it = group->segments.rbegin(); it != group->segments.rend(); ++it) {
+                if ((*it)->lastSequence() != 0) {
+                    group->lastSequence = (*it)->lastSequence();
+                    break;
+                }
+            }
+        }
+
+        FILE* nameFile = fopen((directory + "/name").c_str(), "r");
+        if (nameFile) {
+            char name[256] = {0};
+            if (fgets(name, sizeof(name), nameFile)) {
+                groupNames[groupID] = name;
+            }
+            fclose(nameFile);
+        }
+    }
+
+public:
+    explicit MessageLog(const MessageLogOptions& opts)
+        : options(opts), stopping(false), recordsWritten(0), recordsFailed(0), commits(0) {}
+
+    ~MessageLog() {
+        close();
+    }
+
+    // Create the data directory, recover every group found in it and start
+    // the commit thread
+    bool open() {
+        mkdir(options.directory.c_str(), 0755);
+        DIR* dir = opendir(options.directory.c_str());
+        if (!dir) return false;
+
+        std::vector<uint16_t> found;
+        while (struct dirent* entry = readdir(dir)) {
+            unsigned groupID;
+            if (sscanf(entry->d_name, "group_%u", &groupID) == 1 && groupID > 0 && groupID <= 0xFFFF) {
+                found.push_back(static_cast<uint16_t>(groupID));
+            }
+        }
+        closedir(dir);
+
+        for (uint16_t groupID : found) {
+            recoverGroup(groupID, groupDirectory(groupID));
+        }
+
+        writerThread = std::thread(&MessageLog::writerLoop, this);
+        return true;
+    }
+
+    // Flush everything queued and stop the commit thread
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            if (stopping) return;
+            stopping = true;
+        }
+        pendingCondition.notify_all();
+        if (writerThread.joinable()) {
+            writerThread.join();
+        }
+    }
+
+    // Groups found on disk: ID, name and last durable sequence
+    void forEachRecoveredGroup(
+        const std::function<void(uint16_t, const std::string&, uint32_t)>& fn) {
+        std::lock_guard<std::mutex> lock(groupsMutex);
+        for (const auto& pair : groups) {
+            auto nameIt = groupNames.find(pair.first);
+            std::string name = (nameIt != groupNames.end()) ? nameIt->second : "";
+            fn(pair.first, name, pair.second->lastSequence);
+        }
+    }
+
+    void recordGroup(uint16_t groupID, const std::string& name) {
+        GroupLog* group = findOrCreateGroup(groupID);
+        std::string path = group->directory + "/name";
+        FILE* nameFile = fopen(path.c_str(), "w");
+        if (nameFile) {
+            fputs(name.c_str(), nameFile);
+            fclose(nameFile);
+        }
+        std::lock_guard<std::mutex> lock(groupsMutex);
+        groupNames[groupID] = name;
+    }
+
+    // Queue a message for the next group commit. Called with the group's
+    // publish lock held, so records arrive in sequence order.
+    void append(const ChatPacket& packet, uint32_t sequence) {
+        PendingRecord record;
+        record.groupID = packet.groupID;
+        record.sequence = sequence;
+        record.frame = encodeFrame(packet, WIRE_V2);
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.push_back(std::move(record));
+        }
+        pendingCondition.notify_one();
+    }
+
+    // Up to `limit` committed messages with sequence < beforeSequence,
+    // oldest first (0 means from the newest)
+    std::vector<HistoryEntry> readBefore(uint16_t groupID, uint32_t beforeSequence, size_t limit) {
+        std::vector<HistoryEntry> result;
+        GroupLog* group = findGroup(groupID);
+        if (!group || limit == 0) return result;
+
+        std::lock_guard<std::mutex> lock(group->logMutex);
+        if (beforeSequence == 0) beforeSequence = UINT32_MAX;
+
+        // Walk segments newest to oldest, collecting backwards
+        for (auto it = group->segments.rbegin();
+             it != group->segments.rend() && result.size() < limit; ++it) {
+            const LogSegment& segment = **it;
+            if (segment.firstSequence >= beforeSequence) continue;
+
+            uint32_t position = segment.lowerBound(beforeSequence);
+            while (position > 0 && result.size() < limit) {
+                HistoryEntry entry(0, ChatPacket());
+                if (!segment.readAt(--position, entry)) break;
+                result.push_back(entry);
+            }
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    // Up to `limit` committed messages with sequence > afterSequence, oldest first
+    std::vector<HistoryEntry> readAfter(uint16_t groupID, uint32_t afterSequence, size_t limit) {
+        std::vector<HistoryEntry> result;
+        GroupLog* group = findGroup(groupID);
+        if (!group || limit == 0) return result;
+
+        std::lock_guard<std::mutex> lock(group->logMutex);
+        for (size_t s = 0; s < group->segments.size() && result.size() < limit; ++s) {
+            const LogSegment& segment = *group->segments[s];
+            if (s + 1 < group->segments.size() &&
+                group->segments[s + 1]->firstSequence <= afterSequence + 1) {
+                continue;
+            }
+
+            for (uint32_t position = segment.lowerBound(afterSequence + 1);
+                 position < segment.entryCount && result.size() < limit; ++position) {
+                HistoryEntry entry(0, ChatPacket());
+                if (!segment.readAt(position, entry)) break;
+                result.push_back(entry);
+            }
+        }
+        return result;
+    }
+
+    void getStats(uint64_t& records, uint64_t& commitCount) {
+        records = recordsWritten.load();
+        commitCount = commits.load();
+    }
+
+    // Records that could not be written (segment open or write failed);
+    // they stay in memory history only
+    uint64_t getFailedCount() const {
+        return recordsFailed.load();
+    }
+};
+
+#endif // MESSAGE_LOG_H
@@ -0,0 +1,944 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "../shared/protocol.h"
+#include "../shared/frame.h"
+#include "../shared/metrics.h"
+#include "../shared/lockfree_queue.h"
+#include "../shared/timing_wheel.h"
+
+class Reactor;
+
+// Per-socket state shared between the reactor thread and pool workers.
+// The fd is closed only when the last reference goes away, so a worker
+// still holding a connection can never write into a reused descriptor.
+struct Connection {
+    int fd;
+    uint32_t clientID;
+    std::string clientIP;
+
+    // The reactor that accepted the socket; all I/O for it happens there
+    Reactor* owner;
+
+    // Reactor thread only: bytes received but not yet decoded, how many
+    // frames have been decoded so far, and when bytes last arrived
+    std::vector<char> inBuffer;
+    uint64_t framesDecoded;
+    uint64_t lastActivity;
+    TimerNode idleTimer;
+
+    // Worker side (one task per connection at a time): the current
+    // rate-limit window and the messages counted in it
+    uint64_t rateWindowStart;
+    uint32_t rateCount;
+
+    // Negotiated format for both directions; legacy until MSG_HELLO
+    std::atomic<WireVersion> wireVersion;
+
+    // Decoded packets waiting for a worker, processed strictly in order.
+    // readPaused: the inbox reached Reactor::INBOX_LIMIT and the reactor
+    // stopped reading the socket until a worker drains it.
+    std::mutex inboxMutex;
+    std::deque<ChatPacket> inbox;
+    bool dispatching;
+    bool closed;
+    bool readPaused;
+
+    // Shared frames waiting to be written; the front may be partially sent.
+    // outboundBytes counts whole frames; the first outboundPinned frames
+    // belong to a send still in flight and must stay put.
+    std::mutex sendMutex;
+    std::deque<FramePtr> outbound;
+    size_t outboundOffset;
+    size_t outboundBytes;
+    size_t outboundPinned;
+    bool flushScheduled;
+    // The newest coalescing notice per group and the count it reports,
+    // so the next pass can fold it into a single replacement
+    std::unordered_map<uint16_t, std::pair<FramePtr, uint32_t>> skipNotices;
+
+    // Set when the outbound budget was exceeded under the disconnect
+    // policy; nothing more is queued and the reactor closes the socket
+    std::atomic<bool> evicted;
+
+    Connection(int socketFd, uint32_t id, const std::string& ip)
+        : fd(socketFd), clientID(id), clientIP(ip), owner(nullptr), framesDecoded(0),
+          lastActivity(0), idleTimer(this), rateWindowStart(0), rateCount(0),
+          wireVersion(WIRE_LEGACY), dispatching(false), closed(false), readPaused(false),
+          outboundOffset(0), outboundBytes(0), outboundPinned(0), flushScheduled(false),
+          evicted(false) {}
+
+    ~Connection() {
+        close(fd);
+    }
+};
+
+// What happens to a connection whose queued output exceeds its byte budget
+// (a reader that stopped reading). Only group messages are ever discarded;
+// replies and history pages are always kept.
+enum SlowConsumerPolicy {
+    SLOW_DROP_OLDEST,  // discard the oldest queued group messages
+    SLOW_COALESCE,     // keep only the newest queued message per group, plus a notice
+    SLOW_DISCONNECT    // close the connection
+};
+
+// One message fanned out to the members a single reactor owns. Built by
+// the publishing worker, resolved and written by that reactor's thread.
+struct GroupDelivery {
+    ChatPacket packet;
+    uint32_t sequence;
+    std::vector<uint32_t> members;
+
+    GroupDelivery(const ChatPacket& message, uint32_t seq) : packet(message), sequence(seq) {}
+};
+
+// Mailbox entry: a connection whose outbound queue needs flushing (or,
+// with resume set, whose socket should be read again), or a group delivery
+struct MailboxItem {
+    std::shared_ptr<Connection> conn;
+    std::shared_ptr<GroupDelivery> delivery;
+    bool resume;
+
+    MailboxItem() : resume(false) {}
+};
+
+// Event loop that owns the listening socket and every accepted connection;
+// only complete packets leave the reactor thread. Framing, negotiation,
+// cross-thread send hand-off and bookkeeping live here; a backend supplies
+// the loop itself and the way bytes move (EpollReactor, UringReactor).
+class Reactor {
+protected:
+    int listenFd;
+    int wakeFd;
+    int timerFd;
+    std::atomic<bool> stopping;
+    std::atomic<bool> notified;
+    std::atomic<uint32_t>& clientCounter;
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+
+    // Sharding: this reactor hands out client IDs congruent to shardIndex
+    // modulo shardCount (after dividing out the node, when federated), so
+    // any thread can tell which reactor owns a client from its ID alone.
+    // The ID table is touched by the reactor thread only.
+    uint32_t shardIndex;
+    uint32_t shardCount;
+    uint32_t nodeIndex;
+    uint32_t nodeCount;
+    std::unordered_map<uint32_t, std::shared_ptr<Connection>> clients;
+
+    // Work handed over by other threads. Producers fall back to the locked
+    // overflow list once the queue is full, and keep using it until the
+    // reactor drains it, so items from one producer are never reordered.
+    BoundedQueue<MailboxItem> mailbox;
+    std::mutex overflowMutex;
+    std::vector<MailboxItem> overflow;
+    std::atomic<size_t> overflowCount;
+    std::atomic<bool> wakePending;
+
+    // Optional instruments, set once by attachMetrics() before run()
+    Counter* framesDecodedCounter;
+    Counter* framesQueuedCounter;
+    Histogram* decodeTime;
+    Histogram* sendQueueDepth;
+    Counter* mailboxOverflowCounter;
+    Counter* dropOldestCounter;
+    Counter* coalesceCounter;
+    Counter* disconnectCounter;
+    Counter* framesDiscardedCounter;
+    Counter* readsPausedCounter;
+
+    // Outbound byte budget per connection; 0 = unlimited
+    size_t sendBudget;
+    SlowConsumerPolicy slowPolicy;
+
+    // Connections silent for idleTimeoutMs are closed; 0 = never. Each
+    // connection's timer is re-armed only when it fires, so reads just
+    // stamp lastActivity.
+    uint64_t idleTimeoutMs;
+    TimingWheel idleWheel;
+    Counter* idleClosedCounter;
+
+    // Held open so that, with the descriptor table full, a pending
+    // connection can still be accepted and closed instead of waiting in
+    // the backlog for a readiness event that never comes. If the reserve
+    // is lost, accepting stalls and is retried on the next tick.
+    int reserveFd;
+    bool acceptStalled;
+    Counter* acceptsShedCounter;
+
+    static const int MAX_IOV = 64;
+    // Bytes one connection may have buffered undecoded; a read stops there,
+    // so one fast sender cannot hold the reactor thread or grow its buffer
+    static const size_t READ_BUDGET = 64 * 1024;
+    static const size_t MAILBOX_CAPACITY = 8192;
+    static const uint64_t TICK_MS = 100;
+
+    static bool setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    bool createWakeFd() {
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        return wakeFd >= 0;
+    }
+
+    bool createReserveFd() {
+        reserveFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return reserveFd >= 0;
+    }
+
+    // Out of descriptors: accept one pending connection on the reserve
+    // descriptor and close it at once. Returns false if nothing was
+    // pending or the reserve is gone.
+    bool shedConnection() {
+        if (reserveFd < 0) return false;
+        close(reserveFd);
+        int flags = fcntl(listenFd, F_GETFL, 0);
+        bool blocking = flags >= 0 && !(flags & O_NONBLOCK);
+        if (blocking) fcntl(listenFd, F_SETFL, flags | O_NONBLOCK);
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (blocking) fcntl(listenFd, F_SETFL, flags);
+        if (fd >= 0) {
+            close(fd);
+            if (acceptsShedCounter) acceptsShedCounter->add();
+        }
+        createReserveFd();
+        return fd >= 0 && reserveFd >= 0;
+    }
+
+    // Accept again after a stall on a full descriptor table
+    virtual void retryAccept() = 0;
+
+    // Periodic tick that refreshes the coarse clock and drives the timers
+    bool createTimerFd() {
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timerFd < 0) return false;
+        struct itimerspec interval;
+        interval.it_interval.tv_sec = 0;
+        interval.it_interval.tv_nsec = TICK_MS * 1000000;
+        interval.it_value = interval.it_interval;
+        return timerfd_settime(timerFd, 0, &interval, nullptr) == 0;
+    }
+
+    // Timer fired: close connections idle past the timeout, then run onTick
+    void handleTick() {
+        uint64_t expirations;
+        ssize_t ignored = read(timerFd, &expirations, sizeof(expirations));
+        (void)ignored;
+
+        uint64_t now = CoarseClock::tick();
+        std::vector<std::shared_ptr<Connection>> idle;
+        idleWheel.advance(now, [this, now, &idle](TimerNode* timer) {
+            Connection* conn = static_cast<Connection*>(timer->owner);
+            uint64_t deadline = conn->lastActivity + idleTimeoutMs;
+            if (deadline > now) {
+                idleWheel.schedule(timer, deadline);
+            } else {
+                auto it = connections.find(conn->fd);
+                if (it != connections.end()) idle.push_back(it->second);
+            }
+        });
+        for (const auto& conn : idle) {
+            if (idleClosedCounter) idleClosedCounter->add();
+            closeConnection(conn);
+        }
+
+        if (acceptStalled) {
+            acceptStalled = false;
+            if (reserveFd < 0) createReserveFd();
+            retryAccept();
+        }
+
+        if (onTick) onTick(now);
+    }
+
+    std::shared_ptr<Connection> addConnection(int fd, const std::string& ip) {
+        uint32_t clientID = (clientCounter++ * shardCount + shardIndex) * nodeCount + nodeIndex;
+        auto conn = std::make_shared<Connection>(fd, clientID, ip);
+        conn->owner = this;
+        conn->lastActivity = CoarseClock::nowMs();
+        connections[fd] = conn;
+        clients[clientID] = conn;
+        if (idleTimeoutMs > 0) {
+            idleWheel.schedule(&conn->idleTimer, conn->lastActivity + idleTimeoutMs);
+        }
+        if (onConnect) onConnect(conn);
+        return conn;
+    }
+
+    // Caller is the reactor thread
+    static bool readingPaused(const std::shared_ptr<Connection>& conn) {
+        std::lock_guard<std::mutex> lock(conn->inboxMutex);
+        return conn->readPaused;
+    }
+
+    // Stop reading a connection whose inbox is full. Returns true if it is.
+    bool pauseIfBacklogged(const std::shared_ptr<Connection>& conn) {
+        std::lock_guard<std::mutex> lock(conn->inboxMutex);
+        if (conn->inbox.size() < INBOX_LIMIT) return false;
+        if (!conn->readPaused && readsPausedCounter) readsPausedCounter->add();
+        conn->readPaused = true;
+        return true;
+    }
+
+    // Decode every complete packet in the connection's buffer. The buffer
+    // may end mid-frame or hold several frames; whatever is left over stays
+    // for the next read, as does everything past a full inbox. Returns false
+    // on a malformed frame.
+    bool decodeInput(const std::shared_ptr<Connection>& conn) {
+        conn->lastActivity = CoarseClock::nowMs();
+        bool valid = true;
+        size_t offset = 0;
+        while (offset < conn->inBuffer.size()) {
+            if (onPacket && pauseIfBacklogged(conn)) break;
+            ChatPacket packet;
+            uint64_t decodeStart = decodeTime ? monotonicNanos() : 0;
+            long consumed = decodeFrame(conn->inBuffer.data() + offset,
+                                        conn->inBuffer.size() - offset,
+                                        conn->wireVersion.load(), packet);
+            if (consumed == 0) break;
+            if (decodeTime) {
+                decodeTime->record(monotonicNanos() - decodeStart);
+                framesDecodedCounter->add();
+            }
+            if (consumed < 0) {
+                valid = false;
+                break;
+            }
+            offset += consumed;
+
+            bool first = (conn->framesDecoded++ == 0);
+            if (packet.type == MSG_HELLO && first) {
+                negotiate(conn, packet);
+            } else if (onPacket) {
+                onPacket(conn, packet);
+            }
+        }
+        if (offset > 0) {
+            conn->inBuffer.erase(conn->inBuffer.begin(), conn->inBuffer.begin() + offset);
+        }
+        return valid;
+    }
+
+    // MSG_HELLO must be the first frame on a connection. The reply goes out
+    // in legacy format; every frame after it, in both directions, uses the
+    // agreed version. Handled here so the very next bytes in the buffer are
+    // already decoded in the new format.
+    void negotiate(const std::shared_ptr<Connection>& conn, const ChatPacket& hello) {
+        WireVersion agreed = WIRE_LEGACY;
+        if (hello.payloadSize >= 1 && hello.payload[0] >= WIRE_V2) {
+            agreed = (hello.payload[0] >= WIRE_V3) ? WIRE_V3 : WIRE_V2;
+        }
+
+        ChatPacket reply;
+        reply.type = MSG_HELLO;
+        reply.payload[0] = static_cast<char>(agreed);
+        reply.payloadSize = 1;
+        queueSend(conn, encodeFrame(reply, WIRE_LEGACY));
+
+        conn->wireVersion.store(agreed);
+    }
+
+    // Fill iov from the front of the outbound queue, skipping what was
+    // already sent of the first frame. Caller holds sendMutex.
+    static int gatherOutbound(const std::shared_ptr<Connection>& conn, struct iovec* iov) {
+        int count = 0;
+        for (auto it = conn->outbound.begin();
+             it != conn->outbound.end() && count < MAX_IOV; ++it, ++count) {
+            size_t skip = (count == 0) ? conn->outboundOffset : 0;
+            iov[count].iov_base = const_cast<char*>((*it)->data()) + skip;
+            iov[count].iov_len = (*it)->size() - skip;
+        }
+        return count;
+    }
+
+    // Drop `written` bytes from the front of the outbound queue. Caller
+    // holds sendMutex.
+    static void consumeOutbound(const std::shared_ptr<Connection>& conn, size_t written) {
+        while (written > 0) {
+            size_t frontLeft = conn->outbound.front()->size() - conn->outboundOffset;
+            if (written < frontLeft) {
+                conn->outboundOffset += written;
+                break;
+            }
+            written -= frontLeft;
+            conn->outboundBytes -= conn->outbound.front()->size();
+            conn->outbound.pop_front();
+            conn->outboundOffset = 0;
+        }
+    }
+
+    // Caller holds sendMutex
+    static void clearOutbound(const std::shared_ptr<Connection>& conn) {
+        conn->outbound.clear();
+        conn->outboundOffset = 0;
+        conn->outboundBytes = 0;
+        conn->outboundPinned = 0;
+        conn->skipNotices.clear();
+    }
+
+    // Notice queued in place of the messages coalescing removed
+    static FramePtr skippedNotice(uint16_t groupID, uint32_t skipped, WireVersion version) {
+        ChatPacket notice;
+        notice.type = MSG_ERROR;
+        notice.groupID = groupID;
+        snprintf(notice.payload, sizeof(notice.payload),
+                 "Connection too slow: skipped %u message(s) in group %d; use /history to catch up",
+                 skipped, groupID);
+        notice.payloadSize = static_cast<uint16_t>(strlen(notice.payload));
+        return encodeFrame(notice, version);
+    }
+
+    // Bring a connection back under its budget. Frames a send is using (and
+    // a partially written front frame) are never touched. A connection with
+    // nothing the policy may discard is disconnected instead. Caller holds
+    // sendMutex.
+    void enforceBudget(const std::shared_ptr<Connection>& conn) {
+        if (slowPolicy == SLOW_DISCONNECT) {
+            conn->evicted.store(true);
+            if (disconnectCounter) disconnectCounter->add();
+            return;
+        }
+
+        size_t first = std::max(conn->outboundPinned, conn->outboundOffset > 0 ? size_t(1) : size_t(0));
+        first = std::min(first, conn->outbound.size());
+        std::deque<FramePtr> kept(conn->outbound.begin(), conn->outbound.begin() + first);
+        size_t discarded = 0;
+
+        if (slowPolicy == SLOW_DROP_OLDEST) {
+            // Drop to three quarters of the budget so a reader that stays
+            // slow does not trigger a pass on every new frame
+            size_t target = sendBudget - sendBudget / 4;
+            for (size_t i = first; i < conn->outbound.size(); ++i) {
+                const FramePtr& frame = conn->outbound[i];
+                if (conn->outboundBytes > target && frame->type() == MSG_TEXT) {
+                    conn->outboundBytes -= frame->size();
+                    ++discarded;
+                    continue;
+                }
+                kept.push_back(frame);
+            }
+        } else {
+            std::unordered_map<uint16_t, size_t> newest;
+            for (size_t i = first; i < conn->outbound.size(); ++i) {
+                if (conn->outbound[i]->type() == MSG_TEXT) {
+                    newest[conn->outbound[i]->groupID()] = i;
+                }
+            }
+            std::unordered_map<uint16_t, uint32_t> skipped;
+            WireVersion version = conn->wireVersion.load();
+            for (size_t i = first; i < conn->outbound.size(); ++i) {
+                const FramePtr& frame = conn->outbound[i];
+                if (frame->type() == MSG_ERROR) {
+                    // An earlier pass's notice: its count moves to the new one,
+                    // which always precedes a message of the same group
+                    auto notice = conn->skipNotices.find(frame->groupID());
+                    if (notice != conn->skipNotices.end() && notice->second.first == frame) {
+                        conn->outboundBytes -= frame->size();
+                        skipped[notice->first] += notice->second.second;
+                        conn->skipNotices.erase(notice);
+                        continue;
+                    }
+                }
+                if (frame->type() == MSG_TEXT) {
+                    uint16_t groupID = frame->groupID();
+                    if (newest[groupID] != i) {
+                        conn->outboundBytes -= frame->size();
+                        ++skipped[groupID];
+                        ++discarded;
+                        continue;
+                    }
+                    if (skipped[groupID] > 0) {
+                        FramePtr notice = skippedNotice(groupID, skipped[groupID], version);
+                        conn->skipNotices[groupID] = std::make_pair(notice, skipped[groupID]);
+                        kept.push_back(notice);
+                        conn->outboundBytes += notice->size();
+                    }
+                }
+                kept.push_back(frame);
+            }
+        }
+
+        if (discarded == 0) {
+            // Nothing left to shed: pinned frames, replies and history only
+            // (or, when coalescing, one message per group)
+            conn->evicted.store(true);
+            if (disconnectCounter) disconnectCounter->add();
+            return;
+        }
+        conn->outbound.swap(kept);
+        Counter* policyCounter = (slowPolicy == SLOW_DROP_OLDEST) ? dropOldestCounter : coalesceCounter;
+        if (policyCounter) policyCounter->add();
+        if (framesDiscardedCounter) framesDiscardedCounter->add(discarded);
+    }
+
+    // Start or continue writing a connection's outbound queue
+    virtual void flushConnection(const std::shared_ptr<Connection>& conn) = 0;
+
+    // Decode what is buffered and read the socket again, after a pause or
+    // an exhausted read budget
+    virtual void resumeRead(const std::shared_ptr<Connection>& conn) = 0;
+
+    // Append frames to a connection's outbound queue, back to back, and
+    // apply the budget policy. Returns true if the caller must hand the
+    // connection to the reactor: no flush was scheduled yet, or it was just
+    // evicted.
+    bool appendOutbound(const std::shared_ptr<Connection>& conn,
+                        const FramePtr* frames, size_t count) {
+        std::lock_guard<std::mutex> lock(conn->sendMutex);
+        if (conn->evicted.load()) return false;
+        conn->outbound.insert(conn->outbound.end(), frames, frames + count);
+        for (size_t i = 0; i < count; ++i) {
+            conn->outboundBytes += frames[i]->size();
+        }
+        if (sendQueueDepth) {
+            sendQueueDepth->record(conn->outbound.size());
+            framesQueuedCounter->add(count);
+        }
+        if (sendBudget > 0 && conn->outboundBytes > sendBudget) {
+            enforceBudget(conn);
+            if (conn->evicted.load()) return true;
+        }
+        if (conn->flushScheduled) return false;
+        conn->flushScheduled = true;
+        return true;
+    }
+
+    void post(MailboxItem&& item) {
+        if (overflowCount.load() != 0 || !mailbox.tryPush(std::move(item))) {
+            std::lock_guard<std::mutex> lock(overflowMutex);
+            overflow.push_back(std::move(item));
+            overflowCount.store(overflow.size());
+            if (mailboxOverflowCounter) mailboxOverflowCounter->add();
+        }
+        if (!wakePending.exchange(true)) wake();
+    }
+
+    // Resolve this reactor's slice of a group's members and queue the
+    // message for each of them, encoding once per wire format
+    void deliver(const GroupDelivery& delivery,
+                 std::vector<std::shared_ptr<Connection>>& toFlush) {
+        FramePtr frames[WIRE_V3 + 1];
+        for (uint32_t clientID : delivery.members) {
+            auto it = clients.find(clientID);
+            if (it == clients.end()) continue;
+            const std::shared_ptr<Connection>& conn = it->second;
+            WireVersion version = conn->wireVersion.load();
+            if (!frames[version]) {
+                frames[version] = encodeFrame(delivery.packet, version, delivery.sequence);
+            }
+            if (appendOutbound(conn, &frames[version], 1)) {
+                toFlush.push_back(conn);
+            }
+        }
+    }
+
+    void handleMailboxItem(MailboxItem& item, std::vector<std::shared_ptr<Connection>>& toFlush,
+                           std::vector<std::shared_ptr<Connection>>& toRead) {
+        if (item.delivery) {
+            deliver(*item.delivery, toFlush);
+        } else if (item.conn) {
+            (item.resume ? toRead : toFlush).push_back(std::move(item.conn));
+        }
+    }
+
+    // Eventfd fired: drain the mailbox, flush every connection that gained
+    // output, resume reading those that asked, then run onNotify if asked
+    void handleWakeup() {
+        wakePending.store(false);
+
+        std::vector<std::shared_ptr<Connection>> toFlush;
+        std::vector<std::shared_ptr<Connection>> toRead;
+        MailboxItem item;
+        while (mailbox.tryPop(item)) {
+            handleMailboxItem(item, toFlush, toRead);
+        }
+        if (overflowCount.load() != 0) {
+            std::vector<MailboxItem> batch;
+            {
+                std::lock_guard<std::mutex> lock(overflowMutex);
+                batch.swap(overflow);
+                overflowCount.store(0);
+            }
+            for (auto& entry : batch) {
+                handleMailboxItem(entry, toFlush, toRead);
+            }
+        }
+
+        for (const auto& conn : toFlush) {
+            if (conn->evicted.load()) {
+                auto it = connections.find(conn->fd);
+                if (it != connections.end() && it->second == conn) closeConnection(conn);
+                continue;
+            }
+            flushConnection(conn);
+        }
+        for (const auto& conn : toRead) {
+            auto it = connections.find(conn->fd);
+            if (it != connections.end() && it->second == conn) resumeRead(conn);
+        }
+        if (notified.exchange(false) && onNotify) onNotify();
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    virtual void closeConnection(const std::shared_ptr<Connection>& conn) {
+        shutdown(conn->fd, SHUT_RDWR);
+        connections.erase(conn->fd);
+        clients.erase(conn->clientID);
+        idleWheel.cancel(&conn->idleTimer);
+        if (onDisconnect) onDisconnect(conn);
+    }
+
+    void closeAll() {
+        while (!connections.empty()) {
+            closeConnection(connections.begin()->second);
+        }
+    }
+
+public:
+    std::function<void(const std::shared_ptr<Connection>&)> onConnect;
+    std::function<void(const std::shared_ptr<Connection>&, const ChatPacket&)> onPacket;
+    std::function<void(const std::shared_ptr<Connection>&)> onDisconnect;
+    std::function<void()> onNotify;
+    std::function<void(uint64_t)> onTick;  // every TICK_MS with the coarse time
+
+    // Packets a connection may have waiting for a worker before its socket
+    // is no longer read; the worker resumes it once it is down to half
+    static const size_t INBOX_LIMIT = 256;
+
+    Reactor(int listenSocket, std::atomic<uint32_t>& counter)
+        : listenFd(listenSocket), wakeFd(-1), timerFd(-1), stopping(false), notified(false),
+          clientCounter(counter), shardIndex(0), shardCount(1), nodeIndex(0), nodeCount(1),
+          mailbox(MAILBOX_CAPACITY), overflowCount(0), wakePending(false),
+          framesDecodedCounter(nullptr), framesQueuedCounter(nullptr), decodeTime(nullptr),
+          sendQueueDepth(nullptr), mailboxOverflowCounter(nullptr), dropOldestCounter(nullptr),
+          coalesceCounter(nullptr), disconnectCounter(nullptr), framesDiscardedCounter(nullptr),
+          readsPausedCounter(nullptr),
+          sendBudget(0), slowPolicy(SLOW_DROP_OLDEST), idleTimeoutMs(0),
+          idleWheel(TICK_MS, CoarseClock::nowMs()), idleClosedCounter(nullptr),
+          reserveFd(-1), acceptStalled(false), acceptsShedCounter(nullptr) {}
+
+    virtual ~Reactor() {
+        if (wakeFd >= 0) close(wakeFd);
+        if (timerFd >= 0) close(timerFd);
+        if (reserveFd >= 0) close(reserveFd);
+    }
+
+    virtual bool init() = 0;
+    virtual void run() = 0;
+    virtual const char* getBackendName() const = 0;
+
+    // Make this reactor shard `index` of `count`. Call before run().
+    void setShard(uint32_t index, uint32_t count) {
+        shardIndex = index;
+        shardCount = count;
+    }
+
+    // Federated: make client IDs unique across `count` nodes by folding in
+    // this node's index. Call before run().
+    void setNode(uint32_t index, uint32_t count) {
+        nodeIndex = index;
+        nodeCount = count;
+    }
+
+    // Per-connection outbound budget and what to do past it. Call before run().
+    void setSendBudget(size_t bytes, SlowConsumerPolicy policy) {
+        sendBudget = bytes;
+        slowPolicy = policy;
+    }
+
+    // Close connections that send nothing for this long; 0 = never. Call
+    // before run().
+    void setIdleTimeout(uint64_t milliseconds) {
+        idleTimeoutMs = milliseconds;
+    }
+
+    uint32_t getShardCount() const {
+        return shardCount;
+    }
+
+    // Shard that owns a client ID of this node
+    static uint32_t shardOf(uint32_t clientID, uint32_t count, uint32_t nodes = 1) {
+        return (clientID / nodes) % count;
+    }
+
+    // Queue a frame for delivery on one of this reactor's connections. Safe
+    // from any thread; the reactor performs the actual write so callers
+    // never block on a socket. Only a reference is queued, so one frame can
+    // be shared by every recipient.
+    void queueSend(const std::shared_ptr<Connection>& conn, const FramePtr& frame) {
+        queueSend(conn, &frame, 1);
+    }
+
+    // Queue several frames as one unit: nothing else sent to the connection
+    // can land between them
+    void queueSend(const std::shared_ptr<Connection>& conn, const FramePtr* frames, size_t count) {
+        if (appendOutbound(conn, frames, count)) {
+            MailboxItem item;
+            item.conn = conn;
+            post(std::move(item));
+        }
+    }
+
+    // Read a paused connection again. Safe from any thread.
+    void resumeReading(const std::shared_ptr<Connection>& conn) {
+        MailboxItem item;
+        item.conn = conn;
+        item.resume = true;
+        post(std::move(item));
+    }
+
+    // Hand a message to this reactor for its members of a group. Safe from
+    // any thread; deliveries posted in order are written in that order.
+    void queueDelivery(std::shared_ptr<GroupDelivery> delivery) {
+        MailboxItem item;
+        item.delivery = std::move(delivery);
+        post(std::move(item));
+    }
+
+    // Async-signal-safe: only touches an atomic flag and the eventfd
+    void stop() {
+        stopping.store(true);
+        wake();
+    }
+
+    // Async-signal-safe: run onNotify on the reactor thread at its next wakeup
+    void notify() {
+        notified.store(true);
+        wake();
+    }
+
+    void attachMetrics(MetricsRegistry& registry) {
+        framesDecodedCounter = &registry.counter("reactor.frames_decoded");
+        framesQueuedCounter = &registry.counter("reactor.frames_queued");
+        decodeTime = &registry.histogram("reactor.decode", "ns");
+        sendQueueDepth = &registry.histogram("reactor.send_queue_depth", "frames");
+        mailboxOverflowCounter = &registry.counter("reactor.mailbox_overflow");
+        dropOldestCounter = &registry.counter("outbound.drop_oldest");
+        coalesceCounter = &registry.counter("outbound.coalesce");
+        disconnectCounter = &registry.counter("outbound.disconnect");
+        framesDiscardedCounter = &registry.counter("outbound.frames_discarded");
+        idleClosedCounter = &registry.counter("reactor.idle_closed");
+        readsPausedCounter = &registry.counter("reactor.reads_paused");
+        acceptsShedCounter = &registry.counter("reactor.accepts_shed");
+    }
+
+    size_t getConnectionCount() const {
+        return connections.size();
+    }
+};
+
+// Edge-triggered epoll backend
+class EpollReactor : public Reactor {
+private:
+    int epollFd;
+
+    static const int MAX_EVENTS = 256;
+    static const size_t READ_CHUNK = 16384;
+
+    void acceptConnections() {
+        while (true) {
+            struct sockaddr_in address;
+            socklen_t addrlen = sizeof(address);
+            int fd = accept4(listenFd, (struct sockaddr*)&address, &addrlen,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                if (errno == EMFILE || errno == ENFILE) {
+                    // No new edge comes for connections left in the backlog
+                    if (shedConnection()) continue;
+                    acceptStalled = true;
+                }
+                // EAGAIN: backlog drained
+                return;
+            }
+
+            char ip[INET_ADDRSTRLEN] = "unknown";
+            inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+
+            struct epoll_event ev;
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.fd = fd;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                continue;
+            }
+
+            addConnection(fd, ip);
+        }
+    }
+
+    // Read the socket until EAGAIN or READ_BUDGET buffered bytes, then
+    // decode every complete packet in the buffer. With EPOLLET no new edge
+    // comes for bytes left behind, so a read that stopped early continues
+    // through the mailbox, after other sockets had their turn. A paused
+    // connection is not read at all; its worker resumes it.
+    void readConnection(const std::shared_ptr<Connection>& conn) {
+        if (readingPaused(conn)) return;
+        bool peerClosed = false;
+        bool drained = false;
+        char chunk[READ_CHUNK];
+
+        while (conn->inBuffer.size() < READ_BUDGET) {
+            ssize_t n = recv(conn->fd, chunk, sizeof(chunk), 0);
+            if (n > 0) {
+                conn->inBuffer.insert(conn->inBuffer.end(), chunk, chunk + n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            drained = true;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            peerClosed = true;
+            break;
+        }
+
+        if (!decodeInput(conn) || peerClosed) {
+            closeConnection(conn);
+        } else if (!drained && !readingPaused(conn)) {
+            resumeReading(conn);
+        }
+    }
+
+    void resumeRead(const std::shared_ptr<Connection>& conn) override {
+        readConnection(conn);
+    }
+
+    void retryAccept() override {
+        acceptConnections();
+    }
+
+    // Write as many queued frames as the socket accepts, batching them into
+    // one writev. On EAGAIN the connection stays flagged and the next
+    // EPOLLOUT edge resumes the flush.
+    void flushConnection(const std::shared_ptr<Connection>& conn) override {
+        std::lock_guard<std::mutex> lock(conn->sendMutex);
+
+        while (!conn->outbound.empty()) {
+            struct iovec iov[MAX_IOV];
+            int count = gatherOutbound(conn, iov);
+
+            ssize_t written = writev(conn->fd, iov, count);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+                // Broken pipe or reset: the read side will report the close
+                clearOutbound(conn);
+                break;
+            }
+            consumeOutbound(conn, static_cast<size_t>(written));
+        }
+
+        conn->flushScheduled = false;
+    }
+
+    void closeConnection(const std::shared_ptr<Connection>& conn) override {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+        Reactor::closeConnection(conn);
+    }
+
+public:
+    EpollReactor(int listenSocket, std::atomic<uint32_t>& counter)
+        : Reactor(listenSocket, counter), epollFd(-1) {}
+
+    ~EpollReactor() override {
+        if (epollFd >= 0) close(epollFd);
+    }
+
+    bool init() override {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0 || !createWakeFd() || !createTimerFd() || !createReserveFd() ||
+            !setNonBlocking(listenFd)) {
+            return false;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = listenFd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0) return false;
+
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = wakeFd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev) < 0) return false;
+
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = timerFd;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev) == 0;
+    }
+
+    void run() override {
+        struct epoll_event events[MAX_EVENTS];
+
+        while (!stopping.load()) {
+            int n = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+
+                if (fd == listenFd) {
+                    acceptConnections();
+                    continue;
+                }
+                if (fd == wakeFd) {
+                    uint64_t value;
+                    while (read(wakeFd, &value, sizeof(value)) > 0) {}
+                    handleWakeup();
+                    continue;
+                }
+                if (fd == timerFd) {
+                    handleTick();
+                    continue;
+                }
+
+                auto it = connections.find(fd);
+                if (it == connections.end()) continue;
+                auto conn = it->second;
+
+                if (events[i].events & EPOLLOUT) {
+                    flushConnection(conn);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    readConnection(conn);
+                }
+            }
+        }
+
+        closeAll();
+    }
+
+    const char* getBackendName() const override {
+        return "epoll";
+    }
+};
+
+#endif // REACTOR_H
@@ -0,0 +1,262 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include "thread_pool.cpp"
+#include "message_log.cpp"
+#include "reactor.cpp"
+#include "content_filter.cpp"
+#include "federation.cpp"
+#include "media_server.cpp"
+
+// Upper bound for --reactors
+static const size_t MAX_REACTORS = 64;
+
+// Event loop backend; io_uring falls back to epoll where unsupported
+enum IoBackend {
+    IO_EPOLL,
+    IO_URING
+};
+
+struct ServerConfig {
+    int port;
+    SchedulingPolicy policy;
+    size_t workerThreads;
+    size_t historyDepth;  // messages kept per group in memory
+    bool asyncLog;
+    uint32_t logFlushMs;
+    bool persist;
+    MessageLogOptions logOptions;
+    IoBackend ioBackend;
+    size_t reactorThreads;  // 0 = one per core
+    size_t sendBudget;      // outbound bytes queued per connection, 0 = unlimited
+    SlowConsumerPolicy slowPolicy;
+    uint32_t idleTimeoutSec;  // 0 = keep idle connections forever
+    uint32_t rateLimit;       // messages per second per connection, 0 = unlimited
+    uint32_t sessionTtlSec;   // how long a disconnected session can be resumed, 0 = never
+    std::string filterFile;   // keyword list for the content filter, empty = none
+    FilterKernel filterKernel;  // widest SIMD kernel to use
+    uint32_t nodeIndex;       // this server's position in peers
+    std::vector<PeerAddress> peers;  // peer addresses of every node; empty = standalone
+    std::string peerSecretFile;  // shared secret peer links must present, empty = none
+    int mediaPort;            // media transfer listener, 0 = media disabled
+    std::string mediaDir;     // spool directory, empty = <data-dir>/media
+    uint64_t mediaMaxBytes;   // largest media object accepted
+    uint64_t mediaQuotaBytes; // whole spool, unfinished uploads included
+    uint64_t mediaSenderBytes;  // one sender's share of the spool
+    uint32_t mediaKeepDays;   // complete objects deleted after this, 0 = never
+    
+    ServerConfig() : port(8080), policy(ROUND_ROBIN), workerThreads(4), historyDepth(50),
+                     asyncLog(true), logFlushMs(200), persist(true), ioBackend(IO_EPOLL),
+                     reactorThreads(1), sendBudget(1024 * 1024), slowPolicy(SLOW_DROP_OLDEST),
+                     idleTimeoutSec(0), rateLimit(0), sessionTtlSec(300), filterKernel(KERNEL_AVX2),
+                     nodeIndex(0), mediaPort(0), mediaMaxBytes(64u << 20),
+                     mediaQuotaBytes(4096ull << 20), mediaSenderBytes(512u << 20), mediaKeepDays(30) {}
+};
+
+inline void printServerUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [port] [rr|sjf|ws] [options]" << std::endl;
+    std::cerr << "  --workers=N         thread pool size (default 4)" << std::endl;
+    std::cerr << "  --history-depth=N   recent messages kept per group (default 50)" << std::endl;
+    std::cerr << "  --log-mode=MODE     async (default) or sync" << std::endl;
+    std::cerr << "  --log-flush-ms=N    async log flush interval (default 200)" << std::endl;
+    std::cerr << "  --persist=on|off    durable message log (default on)" << std::endl;
+    std::cerr << "  --data-dir=DIR      message log directory (default ../data)" << std::endl;
+    std::cerr << "  --segment-mb=N      rotate log segments at N MiB (default 64)" << std::endl;
+    std::cerr << "  --retain-segments=N segments kept per group (default 8)" << std::endl;
+    std::cerr << "  --commit-ms=N       group commit window (default 5)" << std::endl;
+    std::cerr << "  --io=epoll|uring    event loop backend (default epoll)" << std::endl;
+    std::cerr << "  --reactors=N        SO_REUSEPORT event loops, 0 = one per core (default 1)" << std::endl;
+    std::cerr << "  --send-budget-kb=N  outbound bytes queued per connection, 0 = unlimited (default 1024)" << std::endl;
+    std::cerr << "  --slow-policy=P     drop-oldest (default), coalesce or disconnect past the budget" << std::endl;
+    std::cerr << "  --idle-timeout=SEC  close connections silent this long, 0 = never (default 0)" << std::endl;
+    std::cerr << "  --rate-limit=N      messages per second per connection, 0 = unlimited (default 0)" << std::endl;
+    std::cerr << "  --session-ttl=SEC   keep a disconnected client's session resumable, 0 = off (default 300)" << std::endl;
+    std::cerr << "  --filter-file=PATH  reject messages containing any keyword listed in PATH" << std::endl;
+    std::cerr << "  --simd=auto|avx2|sse2|scalar  payload scanning kernel (default auto)" << std::endl;
+    std::cerr << "  --media-port=N      accept audio/video transfers on port N, 0 = off (default 0)" << std::endl;
+    std::cerr << "  --media-dir=DIR     media spool directory (default <data-dir>/media)" << std::endl;
+    std::cerr << "  --media-max-mb=N    largest audio/video object accepted (default 64)" << std::endl;
+    std::cerr << "  --media-quota-mb=N  total media spool size (default 4096)" << std::endl;
+    std::cerr << "  --media-sender-mb=N spool space one sender may hold (default 512)" << std::endl;
+    std::cerr << "  --media-keep-days=N delete media older than N days, 0 = never (default 30)" << std::endl;
+    std::cerr << "  --peers=H:P,H:P,... federate with these nodes' peer addresses (this one included)" << std::endl;
+    std::cerr << "  --node=N            this server's index in --peers (default 0)" << std::endl;
+    std::cerr << "  --peer-secret-file=PATH  shared secret every node's peer links must present" << std::endl;
+}
+
+// Positional [port] [rr|sjf|ws] as before, plus --name=value options anywhere
+inline bool parseServerArgs(int argc, char* argv[], ServerConfig& config) {
+    int positional = 0;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        
+        if (arg.compare(0, 2, "--") != 0) {
+            if (positional == 0) {
+                config.port = atoi(arg.c_str());
+            } else if (positional == 1) {
+                if (arg == "sjf") {
+                    config.policy = SHORTEST_JOB_FIRST;
+                } else if (arg == "ws") {
+                    config.policy = WORK_STEALING;
+                } else {
+                    config.policy = ROUND_ROBIN;
+                }
+            } else {
+                return false;
+            }
+            positional++;
+            continue;
+        }
+        
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+        std::string value = (eq == std::string::npos) ? "" : arg.substr(eq + 1);
+        
+        if (name == "workers") {
+            long workers = atol(value.c_str());
+            if (workers <= 0) return false;
+            config.workerThreads = static_cast<size_t>(workers);
+        } else if (name == "history-depth") {
+            long depth = atol(value.c_str());
+            if (depth <= 0) return false;
+            config.historyDepth = static_cast<size_t>(depth);
+        } else if (name == "log-mode") {
+            if (value != "async" && value != "sync") return false;
+            config.asyncLog = (value == "async");
+        } else if (name == "log-flush-ms") {
+            long flushMs = atol(value.c_str());
+            if (flushMs <= 0) return false;
+            config.logFlushMs = static_cast<uint32_t>(flushMs);
+        } else if (name == "persist") {
+            if (value != "on" && value != "off") return false;
+            config.persist = (value == "on");
+        } else if (name == "data-dir") {
+            if (value.empty()) return false;
+            config.logOptions.directory = value;
+        } else if (name == "segment-mb") {
+            long megabytes = atol(value.c_str());
+            if (megabytes <= 0 || megabytes >= 4096) return false;
+            config.logOptions.segmentBytes = static_cast<uint64_t>(megabytes) << 20;
+        } else if (name == "retain-segments") {
+            long segments = atol(value.c_str());
+            if (segments <= 0) return false;
+            config.logOptions.retainSegments = static_cast<uint32_t>(segments);
+        } else if (name == "commit-ms") {
+            long commitMs = atol(value.c_str());
+            if (commitMs < 0) return false;
+            config.logOptions.commitIntervalMs = static_cast<uint32_t>(commitMs);
+        } else if (name == "io") {
+            if (value != "epoll" && value != "uring") return false;
+            config.ioBackend = (value == "uring") ? IO_URING : IO_EPOLL;
+        } else if (name == "reactors") {
+            if (value.empty()) return false;
+            long reactors = atol(value.c_str());
+            if (reactors < 0 || reactors > static_cast<long>(MAX_REACTORS)) return false;
+            config.reactorThreads = static_cast<size_t>(reactors);
+        } else if (name == "send-budget-kb") {
+            if (value.empty()) return false;
+            long kilobytes = atol(value.c_str());
+            if (kilobytes < 0) return false;
+            config.sendBudget = static_cast<size_t>(kilobytes) * 1024;
+        } else if (name == "idle-timeout") {
+            if (value.empty()) return false;
+            long seconds = atol(value.c_str());
+            if (seconds < 0) return false;
+            config.idleTimeoutSec = static_cast<uint32_t>(seconds);
+        } else if (name == "rate-limit") {
+            if (value.empty()) return false;
+            long messages = atol(value.c_str());
+            if (messages < 0) return false;
+            config.rateLimit = static_cast<uint32_t>(messages);
+        } else if (name == "session-ttl") {
+            if (value.empty()) return false;
+            long seconds = atol(value.c_str());
+            if (seconds < 0) return false;
+            config.sessionTtlSec = static_cast<uint32_t>(seconds);
+        } else if (name == "filter-file") {
+            if (value.empty()) return false;
+            config.filterFile = value;
+        } else if (name == "simd") {
+            if (value == "auto" || value == "avx2") {
+                config.filterKernel = KERNEL_AVX2;
+            } else if (value == "sse2") {
+                config.filterKernel = KERNEL_SSE2;
+            } else if (value == "scalar") {
+                config.filterKernel = KERNEL_SCALAR;
+            } else {
+                return false;
+            }
+        } else if (name == "media-port") {
+            if (value.empty()) return false;
+            long mediaPort = atol(value.c_str());
+            if (mediaPort < 0 || mediaPort > 65535) return false;
+            config.mediaPort = static_cast<int>(mediaPort);
+        } else if (name == "media-dir") {
+            if (value.empty()) return false;
+            config.mediaDir = value;
+        } else if (name == "media-max-mb") {
+            long megabytes = atol(value.c_str());
+            if (megabytes <= 0) return false;
+            config.mediaMaxBytes = static_cast<uint64_t>(megabytes) << 20;
+        } else if (name == "media-quota-mb") {
+            long megabytes = atol(value.c_str());
+            if (megabytes <= 0) return false;
+            config.mediaQuotaBytes = static_cast<uint64_t>(megabytes) << 20;
+        } else if (name == "media-sender-mb") {
+            long megabytes = atol(value.c_str());
+            if (megabytes <= 0) return false;
+            config.mediaSenderBytes = static_cast<uint64_t>(megabytes) << 20;
+        } else if (name == "media-keep-days") {
+            if (value.empty()) return false;
+            long days = atol(value.c_str());
+            if (days < 0 || days > 36500) return false;
+            config.mediaKeepDays = static_cast<uint32_t>(days);
+        } else if (name == "node") {
+            if (value.empty()) return false;
+            long node = atol(value.c_str());
+            if (node < 0 || node >= static_cast<long>(MAX_NODES)) return false;
+            config.nodeIndex = static_cast<uint32_t>(node);
+        } else if (name == "peers") {
+            config.peers.clear();
+            size_t start = 0;
+            while (start <= value.size()) {
+                size_t comma = value.find(',', start);
+                std::string entry = value.substr(start, comma == std::string::npos ? std::string::npos
+                                                                                   : comma - start);
+                size_t colon = entry.rfind(':');
+                if (colon == std::string::npos || colon == 0) return false;
+                PeerAddress peer;
+                peer.host = entry.substr(0, colon);
+                peer.port = atoi(entry.c_str() + colon + 1);
+                if (peer.port <= 0 || peer.port > 65535) return false;
+                config.peers.push_back(peer);
+                if (comma == std::string::npos) break;
+                start = comma + 1;
+            }
+            if (config.peers.size() > MAX_NODES) return false;
+        } else if (name == "peer-secret-file") {
+            if (value.empty()) return false;
+            config.peerSecretFile = value;
+        } else if (name == "slow-policy") {
+            if (value == "drop-oldest") {
+                config.slowPolicy = SLOW_DROP_OLDEST;
+            } else if (value == "coalesce") {
+                config.slowPolicy = SLOW_COALESCE;
+            } else if (value == "disconnect") {
+                config.slowPolicy = SLOW_DISCONNECT;
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return config.peers.empty() ? config.nodeIndex == 0 : config.nodeIndex < config.peers.size();
+}
+
+#endif // SERVER_CONFIG_H
@@ -0,0 +1,143 @@
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../shared/protocol.h"
+#include "../shared/timing_wheel.h"
+#include "../shared/utils.h"
+
+// Sessions outlive connections so a client that drops off (a phone
+// switching networks, a laptop waking up) can come back with its token
+// and pick up where it left: its groups, and the messages it missed. A
+// session is attached to at most one connection; when that connection
+// closes, the groups it followed and how far each had got are kept until
+// the session's TTL runs out, measured from the disconnect.
+class SessionStore {
+private:
+    static const uint64_t TICK_MS = 1000;
+
+    struct Session {
+        std::string token;
+        uint32_t clientID;                        // 0 while detached
+        std::vector<ResumePosition> positions;    // set on detach
+        TimerNode expiry;
+
+        Session() : clientID(0), expiry(this) {}
+    };
+
+    std::unordered_map<std::string, std::unique_ptr<Session>> sessions;  // by token
+    std::unordered_map<uint32_t, Session*> attached;                     // by client
+    TimingWheel expiryWheel;
+    uint64_t ttlMs;
+    uint64_t expiredCount;
+    std::mutex storeMutex;
+
+    // Tokens are bearer credentials: anyone holding one can take the
+    // session over, so they come from the kernel CSPRNG. Caller holds
+    // storeMutex.
+    std::string newToken() {
+        std::string token(SESSION_TOKEN_SIZE, '\0');
+        do {
+            secureRandom(&token[0], token.size());
+        } while (token == std::string(SESSION_TOKEN_SIZE, '\0') || sessions.count(token));
+        return token;
+    }
+
+    // Caller holds storeMutex
+    void attach(Session* session, uint32_t clientID) {
+        expiryWheel.cancel(&session->expiry);
+        if (session->clientID != 0) {
+            attached.erase(session->clientID);
+        }
+        session->clientID = clientID;
+        attached[clientID] = session;
+    }
+
+public:
+    explicit SessionStore(uint64_t ttlMilliseconds = 300000)
+        : expiryWheel(TICK_MS, CoarseClock::nowMs()), ttlMs(ttlMilliseconds), expiredCount(0) {}
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    void setTtl(uint64_t ttlMilliseconds) {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        ttlMs = ttlMilliseconds;
+    }
+
+    // Attach a connection to the session with this token, or to a new one
+    // if the token is all zeros, unknown or expired. token is replaced by
+    // the session's token. A session still attached to another connection
+    // (one the server has not yet seen close) is taken over; its positions
+    // are then whatever that connection last recorded, usually none, and
+    // previousClientID is set so the caller can collect its groups.
+    ResumeStatus resume(std::string& token, uint32_t clientID,
+                        std::vector<ResumePosition>& positions, uint32_t& previousClientID) {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        positions.clear();
+        previousClientID = 0;
+
+        auto it = sessions.find(token);
+        if (it != sessions.end()) {
+            Session* session = it->second.get();
+            previousClientID = session->clientID;
+            positions.swap(session->positions);
+            attach(session, clientID);
+            return RESUME_RESTORED;
+        }
+
+        bool presented = (token != std::string(SESSION_TOKEN_SIZE, '\0'));
+        std::unique_ptr<Session> session(new Session());
+        session->token = newToken();
+        token = session->token;
+        attach(session.get(), clientID);
+        sessions[token] = std::move(session);
+        return presented ? RESUME_EXPIRED : RESUME_NEW;
+    }
+
+    bool isAttached(uint32_t clientID) {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        return attached.count(clientID) > 0;
+    }
+
+    // The client's connection closed: keep its groups and positions until
+    // the TTL runs out. No-op for clients without a session, or whose
+    // session has since been taken over by a newer connection.
+    void detach(uint32_t clientID, std::vector<ResumePosition>&& positions) {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        auto it = attached.find(clientID);
+        if (it == attached.end()) return;
+        Session* session = it->second;
+        attached.erase(it);
+        session->clientID = 0;
+        session->positions = std::move(positions);
+        expiryWheel.schedule(&session->expiry, CoarseClock::nowMs() + ttlMs);
+    }
+
+    // Drop detached sessions whose TTL has run out. Call periodically.
+    void sweep() {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        expiryWheel.advance(CoarseClock::nowMs(), [this](TimerNode* timer) {
+            std::string token = static_cast<Session*>(timer->owner)->token;
+            sessions.erase(token);
+            ++expiredCount;
+        });
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        return sessions.size();
+    }
+
+    uint64_t getExpiredCount() {
+        std::lock_guard<std::mutex> lock(storeMutex);
+        return expiredCount;
+    }
+};
+
+#endif // SESSION_STORE_H
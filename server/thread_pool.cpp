@@ -1,27 +1,40 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <algorithm>
 #include <iostream>
 #include <thread>
 #include <mutex>
 #include <queue>
+#include <deque>
+#include <atomic>
 #include <condition_variable>
 #include <functional>
+#include <memory>
+#include <random>
 #include <vector>
 #include <chrono>
+#include "../shared/lockfree_queue.h"
 
 enum SchedulingPolicy {
     ROUND_ROBIN,
-    SHORTEST_JOB_FIRST
+    SHORTEST_JOB_FIRST,
+    WORK_STEALING
 };
 
+// Cost classes a TaskCostModel tracks; what a class means is up to the caller
+static const uint32_t MAX_COST_CLASSES = 256;
+static const uint32_t NO_COST_CLASS = 0xFFFFFFFF;
+
 struct Task {
     std::function<void()> function;
     uint32_t estimatedTime; // For SJF scheduling
     uint32_t taskID;
+    uint32_t costClass;     // measured into the pool's cost model unless NO_COST_CLASS
     
-    Task(std::function<void()> func, uint32_t est = 1, uint32_t id = 0)
-        : function(func), estimatedTime(est), taskID(id) {}
+    Task(std::function<void()> func, uint32_t est = 1, uint32_t id = 0,
+         uint32_t cls = NO_COST_CLASS)
+        : function(std::move(func)), estimatedTime(est), taskID(id), costClass(cls) {}
     
     bool operator<(const Task& other) const {
         // For priority queue (min heap) - shortest time first
@@ -29,6 +42,137 @@ struct Task {
     }
 };
 
+// Online run-time estimates for SJF: an exponentially weighted moving
+// average (1/8 weight per sample) of measured nanoseconds per cost class.
+// A class never measured estimates 0, so its first task runs soon and
+// teaches the model. Updates are load/store rather than CAS: concurrent
+// samples of one class may overwrite each other, which an average shrugs off.
+class TaskCostModel {
+private:
+    std::atomic<uint32_t> averages[MAX_COST_CLASSES];
+    
+public:
+    TaskCostModel() {
+        for (auto& average : averages) {
+            average.store(0, std::memory_order_relaxed);
+        }
+    }
+    
+    uint32_t estimate(uint32_t costClass) const {
+        if (costClass >= MAX_COST_CLASSES) return 0;
+        return averages[costClass].load(std::memory_order_relaxed);
+    }
+    
+    void record(uint32_t costClass, uint64_t nanos) {
+        if (costClass >= MAX_COST_CLASSES) return;
+        int64_t sample = static_cast<int64_t>(std::min<uint64_t>(nanos, 0xFFFFFFFFu));
+        int64_t average = averages[costClass].load(std::memory_order_relaxed);
+        // Seed with the first sample instead of climbing from 0
+        average = (average == 0) ? sample : average + (sample - average) / 8;
+        averages[costClass].store(static_cast<uint32_t>(std::max<int64_t>(average, 1)),
+                                  std::memory_order_relaxed);
+    }
+};
+
+// Chase-Lev work-stealing deque. The owning worker pushes and pops at the
+// bottom without contention; other workers steal from the top with a CAS.
+// The array grows when full; outgrown arrays are kept until destruction
+// because a concurrent thief may still be reading them.
+class WorkStealingDeque {
+private:
+    struct Array {
+        int64_t capacity;
+        std::unique_ptr<std::atomic<Task*>[]> slots;
+        
+        explicit Array(int64_t cap) : capacity(cap), slots(new std::atomic<Task*>[cap]) {}
+        
+        Task* get(int64_t i) const {
+            return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+        void put(int64_t i, Task* task) {
+            slots[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+        }
+    };
+    
+    alignas(64) std::atomic<int64_t> top;
+    alignas(64) std::atomic<int64_t> bottom;
+    std::atomic<Array*> array;
+    std::vector<std::unique_ptr<Array>> arrays; // owner thread only
+    
+    Array* grow(Array* old, int64_t b, int64_t t) {
+        Array* bigger = new Array(old->capacity * 2);
+        for (int64_t i = t; i < b; ++i) {
+            bigger->put(i, old->get(i));
+        }
+        arrays.emplace_back(bigger);
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+    
+public:
+    WorkStealingDeque() : top(0), bottom(0) {
+        arrays.emplace_back(new Array(256));
+        array.store(arrays.back().get(), std::memory_order_relaxed);
+    }
+    
+    // Owner only
+    void push(Task* task) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Array* a = array.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = grow(a, b, t);
+        }
+        a->put(b, task);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    
+    // Owner only; LIFO end
+    Task* pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Task* task = a->get(b);
+        if (t == b) {
+            // Last element: race any thief for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed)) {
+                task = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+    
+    // Any thread; FIFO end
+    Task* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        
+        Array* a = array.load(std::memory_order_acquire);
+        Task* task = a->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed)) {
+            return nullptr; // lost the race
+        }
+        return task;
+    }
+    
+    bool empty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+};
+
 class ThreadPool {
 private:
     std::vector<std::thread> workers;
@@ -36,53 +180,175 @@ private:
     std::priority_queue<Task> sjfQueue; // SJF priority queue
     std::mutex queueMutex;
     std::condition_variable condition;
-    bool stop;
+    std::atomic<bool> stop;
     SchedulingPolicy policy;
     
+    // Work stealing: one deque per worker, plus a lock-free injection queue
+    // for tasks submitted from outside the pool (mutex-guarded overflow if
+    // it fills up). Idle workers park on parkCondition.
+    std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+    std::unique_ptr<BoundedQueue<Task*>> injectionQueue;
+    std::deque<Task*> overflowQueue;
+    std::mutex overflowMutex;
+    std::atomic<size_t> overflowCount;
+    std::mutex parkMutex;
+    std::condition_variable parkCondition;
+    std::atomic<int> parkedWorkers;
+    
+    static thread_local ThreadPool* currentPool;
+    static thread_local size_t currentWorker;
+    
     // Statistics
-    uint64_t tasksProcessed;
-    uint64_t totalWaitTime;
-    std::mutex statsMutex;
+    std::atomic<uint64_t> tasksProcessed;
+    std::atomic<uint64_t> totalWaitTime;
+    std::atomic<uint64_t> tasksStolen;
+    
+    TaskCostModel costModel;
+    
+    void runTask(const Task& task) {
+        auto start = std::chrono::steady_clock::now();
+        task.function();
+        auto end = std::chrono::steady_clock::now();
+        
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        if (task.costClass != NO_COST_CLASS) {
+            costModel.record(task.costClass, nanos);
+        }
+        tasksProcessed.fetch_add(1, std::memory_order_relaxed);
+        totalWaitTime.fetch_add(nanos / 1000, std::memory_order_relaxed);
+    }
+    
+    void queueWorker() {
+        while (true) {
+            Task task([](){}, 0, 0);
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                condition.wait(lock, [this] { 
+                    return stop || (policy == ROUND_ROBIN ? !rrQueue.empty() : !sjfQueue.empty()); 
+                });
+                
+                if (policy == ROUND_ROBIN && !rrQueue.empty()) {
+                    task = std::move(rrQueue.front());
+                    rrQueue.pop();
+                } else if (policy == SHORTEST_JOB_FIRST && !sjfQueue.empty()) {
+                    // top() is const; the element is popped right after
+                    task = std::move(const_cast<Task&>(sjfQueue.top()));
+                    sjfQueue.pop();
+                } else {
+                    return; // stopping and drained
+                }
+            }
+            
+            runTask(task);
+        }
+    }
+    
+    Task* takeInjected() {
+        Task* task = nullptr;
+        if (injectionQueue->tryPop(task)) return task;
+        if (overflowCount.load(std::memory_order_acquire) == 0) return nullptr;
+        
+        std::lock_guard<std::mutex> lock(overflowMutex);
+        if (overflowQueue.empty()) return nullptr;
+        task = overflowQueue.front();
+        overflowQueue.pop_front();
+        overflowCount.fetch_sub(1, std::memory_order_release);
+        return task;
+    }
+    
+    Task* findWork(size_t self, std::minstd_rand& rng) {
+        Task* task = deques[self]->pop();
+        if (task) return task;
+        
+        task = takeInjected();
+        if (task) return task;
+        
+        // Randomized victim order spreads thieves across deques
+        size_t count = deques.size();
+        size_t start = rng() % count;
+        for (size_t i = 0; i < count; ++i) {
+            size_t victim = (start + i) % count;
+            if (victim == self) continue;
+            task = deques[victim]->steal();
+            if (task) {
+                tasksStolen.fetch_add(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+    
+    bool hasVisibleWork() {
+        if (injectionQueue->sizeApprox() > 0 || overflowCount.load() > 0) return true;
+        for (const auto& deque : deques) {
+            if (!deque->empty()) return true;
+        }
+        return false;
+    }
+    
+    void stealingWorker(size_t self) {
+        currentPool = this;
+        currentWorker = self;
+        std::minstd_rand rng(static_cast<unsigned>(self * 7919 + 1));
+        
+        while (true) {
+            Task* task = nullptr;
+            
+            // Spin briefly before parking; a new task usually follows soon
+            for (int attempt = 0; attempt < 64 && !task; ++attempt) {
+                task = findWork(self, rng);
+                if (!task) std::this_thread::yield();
+            }
+            
+            if (task) {
+                runTask(*task);
+                delete task;
+                continue;
+            }
+            
+            std::unique_lock<std::mutex> lock(parkMutex);
+            parkedWorkers.fetch_add(1);
+            // Re-check after announcing ourselves so a concurrent enqueue
+            // either sees the parked count or we see its task
+            if (!hasVisibleWork()) {
+                if (stop.load()) {
+                    parkedWorkers.fetch_sub(1);
+                    return;
+                }
+                parkCondition.wait_for(lock, std::chrono::milliseconds(100));
+            }
+            parkedWorkers.fetch_sub(1);
+        }
+    }
+    
+    void wakeParkedWorker() {
+        // Order the push before reading the parked count (pairs with the
+        // fetch_add in stealingWorker)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parkedWorkers.load() > 0) {
+            std::lock_guard<std::mutex> lock(parkMutex);
+            parkCondition.notify_one();
+        }
+    }
     
 public:
     ThreadPool(size_t threads, SchedulingPolicy p = ROUND_ROBIN) 
-        : stop(false), policy(p), tasksProcessed(0), totalWaitTime(0) {
+        : stop(false), policy(p), overflowCount(0), parkedWorkers(0),
+          tasksProcessed(0), totalWaitTime(0), tasksStolen(0) {
+        
+        if (policy == WORK_STEALING) {
+            injectionQueue.reset(new BoundedQueue<Task*>(4096));
+            for (size_t i = 0; i < threads; ++i) {
+                deques.emplace_back(new WorkStealingDeque());
+            }
+        }
         
         for (size_t i = 0; i < threads; ++i) {
-            workers.emplace_back([this] {
-                while (true) {
-                    Task task([](){}, 0, 0);
-                    {
-                        std::unique_lock<std::mutex> lock(queueMutex);
-                        condition.wait(lock, [this] { 
-                            return stop || !rrQueue.empty() || !sjfQueue.empty(); 
-                        });
-                        
-                        if (stop && rrQueue.empty() && sjfQueue.empty()) 
-                            return;
-                        
-                        if (policy == ROUND_ROBIN && !rrQueue.empty()) {
-                            task = std::move(rrQueue.front());
-                            rrQueue.pop();
-                        } else if (policy == SHORTEST_JOB_FIRST && !sjfQueue.empty()) {
-                            task = sjfQueue.top();
-                            sjfQueue.pop();
-                        } else {
-                            continue;
-                        }
-                    }
-                    
-                    auto start = std::chrono::steady_clock::now();
-                    task.function();
-                    auto end = std::chrono::steady_clock::now();
-                    
-                    {
-                        std::lock_guard<std::mutex> lock(statsMutex);
-                        tasksProcessed++;
-                        totalWaitTime += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-                    }
-                }
-            });
+            if (policy == WORK_STEALING) {
+                workers.emplace_back([this, i] { stealingWorker(i); });
+            } else {
+                workers.emplace_back([this] { queueWorker(); });
+            }
         }
     }
     
@@ -92,6 +358,10 @@ public:
             stop = true;
         }
         condition.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(parkMutex);
+            parkCondition.notify_all();
+        }
         for (auto& worker : workers) {
             if (worker.joinable()) {
                 worker.join();
@@ -99,23 +369,58 @@ public:
         }
     }
     
-    void enqueue(std::function<void()> task, uint32_t estimatedTime = 1, uint32_t taskID = 0) {
+    void enqueue(std::function<void()> task, uint32_t estimatedTime = 1, uint32_t taskID = 0,
+                 uint32_t costClass = NO_COST_CLASS) {
+        if (policy == WORK_STEALING) {
+            Task* item = new Task(std::move(task), estimatedTime, taskID, costClass);
+            if (currentPool == this) {
+                deques[currentWorker]->push(item);
+            } else if (!injectionQueue->tryPush(item)) {
+                std::lock_guard<std::mutex> lock(overflowMutex);
+                overflowQueue.push_back(item);
+                overflowCount.fetch_add(1, std::memory_order_release);
+            }
+            wakeParkedWorker();
+            return;
+        }
+        
         {
             std::unique_lock<std::mutex> lock(queueMutex);
             if (policy == ROUND_ROBIN) {
-                rrQueue.emplace(task, estimatedTime, taskID);
+                rrQueue.emplace(std::move(task), estimatedTime, taskID, costClass);
             } else {
-                sjfQueue.emplace(task, estimatedTime, taskID);
+                sjfQueue.emplace(std::move(task), estimatedTime, taskID, costClass);
             }
         }
         condition.notify_one();
     }
     
+    // Enqueue with the measured average of costClass as the SJF estimate;
+    // the task's own run time then updates that average
+    void enqueueMeasured(std::function<void()> task, uint32_t costClass, uint32_t taskID = 0) {
+        enqueue(std::move(task), costModel.estimate(costClass), taskID, costClass);
+    }
+    
+    // Current estimate in nanoseconds, 0 if costClass was never measured
+    uint32_t getCostEstimate(uint32_t costClass) const {
+        return costModel.estimate(costClass);
+    }
+    
     void getStats(uint64_t& processed, uint64_t& avgWaitTime) {
-        std::lock_guard<std::mutex> lock(statsMutex);
-        processed = tasksProcessed;
-        avgWaitTime = (tasksProcessed > 0) ? (totalWaitTime / tasksProcessed) : 0;
+        processed = tasksProcessed.load();
+        avgWaitTime = (processed > 0) ? (totalWaitTime.load() / processed) : 0;
+    }
+    
+    uint64_t getStolenCount() const {
+        return tasksStolen.load();
+    }
+    
+    SchedulingPolicy getPolicy() const {
+        return policy;
     }
 };
 
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+thread_local size_t ThreadPool::currentWorker = 0;
+
 #endif // THREAD_POOL_H
@@ -0,0 +1,603 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "reactor.cpp"
+
+// Just enough of io_uring over raw syscalls to drive the reactor, so the
+// server needs no liburing. One thread owns the ring: SQEs are prepared
+// during a loop iteration and handed to the kernel together by
+// submitAndWait().
+class IoUring {
+private:
+    int ringFd;
+    unsigned features;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocalTail;   // prepared, not yet visible to the kernel
+    unsigned sqSubmitted;   // last tail handed to io_uring_enter
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete,
+                                        flags, nullptr, 0));
+    }
+
+public:
+    IoUring()
+        : ringFd(-1), features(0), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+          sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)), sqesSize(0),
+          sqHead(nullptr), sqTail(nullptr), sqArray(nullptr), sqMask(0), sqEntries(0),
+          sqLocalTail(0), sqSubmitted(0), cqHead(nullptr), cqTail(nullptr), cqMask(0),
+          cqes(nullptr) {}
+
+    ~IoUring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+
+    bool setup(unsigned entries, unsigned completionEntries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = completionEntries;
+
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd < 0) {
+            return false;
+        }
+        features = params.features;
+        // Older kernels could drop completions on overflow
+        if (!(params.features & IORING_FEAT_NODROP)) {
+            return false;
+        }
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        cqRing = singleMmap ? sqRing
+                            : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = static_cast<struct io_uring_sqe*>(
+            mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ringFd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        sqLocalTail = sqSubmitted = *sqTail;
+
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    int fd() const {
+        return ringFd;
+    }
+
+    bool hasFeature(unsigned feature) const {
+        return (features & feature) != 0;
+    }
+
+    // A zeroed SQE, submitted with the next submitAndWait(). If the queue
+    // is full, what is already prepared is submitted first.
+    struct io_uring_sqe* getSqe() {
+        if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            submitAndWait(0);
+            if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+                return nullptr;
+            }
+        }
+        unsigned index = sqLocalTail & sqMask;
+        struct io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        ++sqLocalTail;
+        return sqe;
+    }
+
+    // Publish every prepared SQE and wait for at least waitFor completions,
+    // all in one syscall
+    int submitAndWait(unsigned waitFor) {
+        __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+        unsigned toSubmit = sqLocalTail - sqSubmitted;
+        if (toSubmit == 0 && waitFor == 0) {
+            return 0;
+        }
+        int ret = enter(toSubmit, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0) {
+            sqSubmitted += static_cast<unsigned>(ret);
+        }
+        return ret;
+    }
+
+    // Hand every available completion to fn, then release them to the kernel
+    template <typename Fn>
+    unsigned forEachCompletion(Fn&& fn) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            fn(cqes[head & cqMask]);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+};
+
+// io_uring backend. Accept and receive are multishot: one request keeps
+// producing completions, and receives land in kernel-selected buffers from
+// a shared provided-buffer group, so an idle connection pins no buffer. Sends are
+// one sendmsg per connection at a time, gathering its whole outbound queue.
+// Everything prepared while handling one batch of completions goes to the
+// kernel in a single io_uring_enter, which also waits for the next batch.
+class UringReactor : public Reactor {
+private:
+    enum Operation : uint64_t {
+        OP_ACCEPT = 1,
+        OP_WAKE = 2,
+        OP_RECV = 3,
+        OP_SEND = 4,
+        OP_PROVIDE = 5,
+        OP_TIMER = 6,
+        OP_CANCEL = 7
+    };
+
+    // Reactor-side state per socket. It keeps the connection (and so the
+    // fd) alive until every request referencing it has completed, so a
+    // late completion can never be mistaken for a newer socket's.
+    struct SocketState {
+        std::shared_ptr<Connection> conn;
+        unsigned inflight;
+        bool receiving;
+        bool sending;
+        bool closing;
+        bool cancelling;
+        struct msghdr message;
+        std::vector<struct iovec> iov;
+
+        SocketState() : inflight(0), receiving(false), sending(false), closing(false),
+                        cancelling(false) {
+            memset(&message, 0, sizeof(message));
+        }
+    };
+
+    static const unsigned RING_ENTRIES = 4096;
+    static const unsigned BUFFER_COUNT = 1024;   // power of two
+    static const unsigned BUFFER_SIZE = 4096;
+    static const uint16_t BUFFER_GROUP = 0;
+
+    IoUring ring;
+    std::unordered_map<int, SocketState> sockets;
+
+    // Receive buffers lent to the kernel as one provided-buffer group
+    char* bufferMemory;
+
+    // Cleared if the kernel rejects the multishot flag; single-shot
+    // requests are then re-armed after every completion
+    bool multishotAccept;
+    bool multishotRecv;
+
+    static uint64_t userData(Operation op, int fd) {
+        return (static_cast<uint64_t>(op) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    // Hand the whole pool to the kernel in one request and check that the
+    // kernel accepted it
+    bool setupBuffers() {
+        void* memory = mmap(nullptr, static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE,
+                            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return false;
+        bufferMemory = static_cast<char*>(memory);
+
+        struct io_uring_sqe* sqe = ring.getSqe();
+        if (!sqe) return false;
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = BUFFER_COUNT;
+        sqe->addr = reinterpret_cast<uint64_t>(bufferMemory);
+        sqe->len = BUFFER_SIZE;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->off = 0;
+        if (ring.submitAndWait(1) < 0) return false;
+
+        int result = -1;
+        ring.forEachCompletion([&result](const struct io_uring_cqe& cqe) { result = cqe.res; });
+        return result >= 0;
+    }
+
+    // Return one buffer to the kernel. Batched with everything else
+    // prepared this iteration; only failures produce a completion.
+    void provideBuffer(uint16_t id) {
+        struct io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<uint64_t>(bufferMemory + static_cast<size_t>(id) * BUFFER_SIZE);
+        sqe->len = BUFFER_SIZE;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->off = id;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = userData(OP_PROVIDE, 0);
+    }
+
+    struct io_uring_sqe* nextSqe() {
+        struct io_uring_sqe* sqe = ring.getSqe();
+        // Only if the kernel stopped consuming submissions altogether
+        while (!sqe) {
+            std::this_thread::yield();
+            sqe = ring.getSqe();
+        }
+        return sqe;
+    }
+
+    void armAccept() {
+        struct io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listenFd;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        if (multishotAccept) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+        sqe->user_data = userData(OP_ACCEPT, listenFd);
+    }
+
+    void armWake() {
+        struct io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = wakeFd;
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = userData(OP_WAKE, wakeFd);
+    }
+
+    void armTimer() {
+        struct io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = timerFd;
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->user_data = userData(OP_TIMER, timerFd);
+    }
+
+    void armRecv(int fd, SocketState& state) {
+        struct io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        if (multishotRecv) sqe->ioprio |= IORING_RECV_MULTISHOT;
+        sqe->user_data = userData(OP_RECV, fd);
+        ++state.inflight;
+        state.receiving = true;
+    }
+
+    // End a paused connection's multishot receive; its final completion
+    // arrives with -ECANCELED and is not re-armed while the pause lasts
+    void cancelRecv(int fd, SocketState& state) {
+        struct io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = userData(OP_RECV, fd);
+        sqe->user_data = userData(OP_CANCEL, fd);
+        ++state.inflight;
+        state.cancelling = true;
+    }
+
+    void handleAccept(const struct io_uring_cqe& cqe) {
+        bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+        if (cqe.res == -EINVAL && multishotAccept) {
+            multishotAccept = false;
+        }
+
+        if (cqe.res >= 0) {
+            int fd = cqe.res;
+            struct sockaddr_in address;
+            socklen_t addrlen = sizeof(address);
+            char ip[INET_ADDRSTRLEN] = "unknown";
+            if (getpeername(fd, (struct sockaddr*)&address, &addrlen) == 0) {
+                inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+            }
+
+            SocketState& state = sockets[fd];
+            state.conn = addConnection(fd, ip);
+            armRecv(fd, state);
+        }
+
+        // Out of descriptors the accept would fail again at once: shed the
+        // pending connection, or re-arm from the next tick
+        if ((cqe.res == -EMFILE || cqe.res == -ENFILE) && !shedConnection() && !more) {
+            acceptStalled = true;
+        }
+        // Errors end a multishot accept too
+        if (!more && !stopping.load() && !acceptStalled) {
+            armAccept();
+        }
+    }
+
+    void handleRecv(const struct io_uring_cqe& cqe) {
+        int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+        bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            uint16_t id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            auto it = sockets.find(fd);
+            if (cqe.res > 0 && it != sockets.end() && !it->second.closing) {
+                const char* data = bufferMemory + static_cast<size_t>(id) * BUFFER_SIZE;
+                it->second.conn->inBuffer.insert(it->second.conn->inBuffer.end(),
+                                                 data, data + cqe.res);
+            }
+            provideBuffer(id);
+        }
+
+        auto it = sockets.find(fd);
+        if (it == sockets.end()) return;
+        SocketState& state = it->second;
+        if (!more) {
+            --state.inflight;
+            state.receiving = false;
+        }
+
+        if (state.closing) {
+            releaseIfDone(fd, state);
+            return;
+        }
+
+        std::shared_ptr<Connection> conn = state.conn;
+        bool keepOpen = true;
+        if (cqe.res > 0) {
+            keepOpen = decodeInput(conn);
+        } else if (cqe.res == -EINVAL && multishotRecv) {
+            multishotRecv = false;
+        } else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            keepOpen = false; // 0 is EOF; anything else is a socket error
+        }
+
+        if (!keepOpen) {
+            closeConnection(conn);
+        } else if (backlogged(conn)) {
+            // Bytes already in flight still land in inBuffer, undecoded
+            if (state.receiving && !state.cancelling) cancelRecv(fd, state);
+        } else if (!state.receiving) {
+            armRecv(fd, state);
+        }
+    }
+
+    // Receiving waits while the inbox is full or undecoded bytes pile up.
+    // A worker may have lifted the pause before the bytes were decoded,
+    // so the buffer counts too; its resumeReading() re-arms the receive.
+    bool backlogged(const std::shared_ptr<Connection>& conn) {
+        return conn->inBuffer.size() >= READ_BUDGET || readingPaused(conn);
+    }
+
+    void handleCancel(const struct io_uring_cqe& cqe) {
+        int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+        auto it = sockets.find(fd);
+        if (it == sockets.end()) return;
+        --it->second.inflight;
+        it->second.cancelling = false;
+        releaseIfDone(fd, it->second);
+    }
+
+    // Decode what piled up during the pause, then receive again unless the
+    // inbox filled once more
+    void resumeRead(const std::shared_ptr<Connection>& conn) override {
+        auto it = sockets.find(conn->fd);
+        if (it == sockets.end() || it->second.conn != conn || it->second.closing) return;
+        SocketState& state = it->second;
+        if (!decodeInput(conn)) {
+            closeConnection(conn);
+        } else if (!backlogged(conn) && !state.receiving) {
+            armRecv(conn->fd, state);
+        }
+    }
+
+    void handleSend(const struct io_uring_cqe& cqe) {
+        int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+        auto it = sockets.find(fd);
+        if (it == sockets.end()) return;
+        SocketState& state = it->second;
+        --state.inflight;
+        state.sending = false;
+
+        const std::shared_ptr<Connection>& conn = state.conn;
+        bool more;
+        {
+            std::lock_guard<std::mutex> lock(conn->sendMutex);
+            conn->outboundPinned = 0;
+            if (cqe.res > 0 && !state.closing) {
+                consumeOutbound(conn, static_cast<size_t>(cqe.res));
+            } else {
+                // Broken pipe or reset: the receive side will report the close
+                clearOutbound(conn);
+            }
+            more = !conn->outbound.empty();
+            if (!more) conn->flushScheduled = false;
+        }
+
+        if (state.closing) {
+            releaseIfDone(fd, state);
+        } else if (more) {
+            flushConnection(conn);
+        }
+    }
+
+    // Forget a closed socket once the kernel holds no request against it
+    void releaseIfDone(int fd, SocketState& state) {
+        if (state.closing && state.inflight == 0) {
+            sockets.erase(fd);
+        }
+    }
+
+    void handleCompletion(const struct io_uring_cqe& cqe) {
+        switch (static_cast<Operation>(cqe.user_data >> 32)) {
+            case OP_ACCEPT:
+                handleAccept(cqe);
+                break;
+            case OP_WAKE: {
+                uint64_t value;
+                while (read(wakeFd, &value, sizeof(value)) > 0) {}
+                if (!(cqe.flags & IORING_CQE_F_MORE)) armWake();
+                handleWakeup();
+                break;
+            }
+            case OP_RECV:
+                handleRecv(cqe);
+                break;
+            case OP_SEND:
+                handleSend(cqe);
+                break;
+            case OP_TIMER:
+                if (!(cqe.flags & IORING_CQE_F_MORE)) armTimer();
+                handleTick();
+                break;
+            case OP_CANCEL:
+                handleCancel(cqe);
+                break;
+            case OP_PROVIDE:
+                break;
+        }
+    }
+
+    // Gather the outbound queue into one sendmsg. A connection has at most
+    // one send in flight; its completion continues with whatever was queued
+    // meanwhile.
+    void flushConnection(const std::shared_ptr<Connection>& conn) override {
+        auto it = sockets.find(conn->fd);
+        if (it == sockets.end() || it->second.conn != conn || it->second.closing) {
+            std::lock_guard<std::mutex> lock(conn->sendMutex);
+            if (conn->outboundPinned == 0) clearOutbound(conn);
+            conn->flushScheduled = false;
+            return;
+        }
+        SocketState& state = it->second;
+        if (state.sending) return;
+
+        {
+            std::lock_guard<std::mutex> lock(conn->sendMutex);
+            if (conn->outbound.empty()) {
+                conn->flushScheduled = false;
+                return;
+            }
+            state.iov.resize(MAX_IOV);
+            state.message.msg_iov = state.iov.data();
+            state.message.msg_iovlen = gatherOutbound(conn, state.iov.data());
+            conn->outboundPinned = state.message.msg_iovlen;
+        }
+
+        struct io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&state.message);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = userData(OP_SEND, conn->fd);
+        state.sending = true;
+        ++state.inflight;
+    }
+
+    void retryAccept() override {
+        if (!stopping.load()) armAccept();
+    }
+
+    void closeConnection(const std::shared_ptr<Connection>& conn) override {
+        auto it = sockets.find(conn->fd);
+        if (it != sockets.end()) {
+            it->second.closing = true;
+        }
+        // shutdown() ends the pending receive, which releases the socket
+        Reactor::closeConnection(conn);
+        if (it != sockets.end()) {
+            releaseIfDone(conn->fd, it->second);
+        }
+    }
+
+public:
+    UringReactor(int listenSocket, std::atomic<uint32_t>& counter)
+        : Reactor(listenSocket, counter), bufferMemory(nullptr),
+          multishotAccept(true), multishotRecv(true) {}
+
+    ~UringReactor() override {
+        sockets.clear();
+        if (bufferMemory) munmap(bufferMemory, static_cast<size_t>(BUFFER_COUNT) * BUFFER_SIZE);
+    }
+
+    // Fails on kernels without io_uring or provided buffers, or where
+    // io_uring is disabled; callers fall back to epoll
+    bool init() override {
+        return ring.setup(RING_ENTRIES, RING_ENTRIES * 4) &&
+               ring.hasFeature(IORING_FEAT_CQE_SKIP) && setupBuffers() && createWakeFd() &&
+               createTimerFd() && createReserveFd();
+    }
+
+    void run() override {
+        armAccept();
+        armWake();
+        armTimer();
+
+        while (!stopping.load()) {
+            int ret = ring.submitAndWait(1);
+            if (ret < 0 && errno != EINTR && errno != EBUSY) {
+                break;
+            }
+            ring.forEachCompletion([this](const struct io_uring_cqe& cqe) {
+                handleCompletion(cqe);
+            });
+        }
+
+        closeAll();
+
+        // Let shut-down sockets finish their outstanding requests so no
+        // send is still reading frames when they are freed
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (!sockets.empty() && std::chrono::steady_clock::now() < deadline) {
+            ring.submitAndWait(0);
+            if (ring.forEachCompletion([this](const struct io_uring_cqe& cqe) {
+                    handleCompletion(cqe);
+                }) == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    const char* getBackendName() const override {
+        return "io_uring";
+    }
+};
+
+#endif // URING_REACTOR_H
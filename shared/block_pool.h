@@ -0,0 +1,134 @@
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include "lockfree_queue.h"
+
+// Recycles fixed-size blocks so objects created and destroyed on every
+// message (encoded frames, group deliveries) stop going through malloc.
+// Each thread keeps a small free list it touches without synchronization;
+// past its limit a thread hands blocks to a shared lock-free depot, and an
+// empty thread refills from it, so blocks freed on a reactor thread find
+// their way back to the workers that allocate them. Only when both are
+// exhausted (warm-up, bursts) does the pool fall back to operator new.
+template <size_t BlockSize>
+class BlockPool {
+private:
+    static const size_t THREAD_CACHE_LIMIT = 256;
+    static const size_t DEPOT_CAPACITY = 4096;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static_assert(BlockSize >= sizeof(FreeBlock), "block too small for the free list");
+
+    struct ThreadCache {
+        FreeBlock* head;
+        size_t count;
+        bool retired;
+    };
+
+    // Trivially destructible, so it stays usable while the thread's other
+    // thread_local objects are being torn down
+    static ThreadCache& threadCache() {
+        static thread_local ThreadCache cache = {nullptr, 0, false};
+        return cache;
+    }
+
+    // Never destroyed: blocks may be released during static destruction
+    static BoundedQueue<void*>& depot() {
+        static BoundedQueue<void*>* shared = new BoundedQueue<void*>(DEPOT_CAPACITY);
+        return *shared;
+    }
+
+    static void releaseShared(void* block) {
+        if (!depot().tryPush(block)) {
+            ::operator delete(block);
+        }
+    }
+
+    // Returns a thread's cached blocks to the depot when it exits
+    struct Retirer {
+        ~Retirer() {
+            ThreadCache& cache = threadCache();
+            cache.retired = true;
+            while (cache.head) {
+                FreeBlock* block = cache.head;
+                cache.head = block->next;
+                releaseShared(block);
+            }
+            cache.count = 0;
+        }
+    };
+
+public:
+    static void* allocate() {
+        static thread_local Retirer retirer;
+        (void)retirer;
+
+        ThreadCache& cache = threadCache();
+        if (cache.head) {
+            FreeBlock* block = cache.head;
+            cache.head = block->next;
+            --cache.count;
+            return block;
+        }
+        void* block;
+        if (depot().tryPop(block)) {
+            return block;
+        }
+        return ::operator new(BlockSize);
+    }
+
+    static void deallocate(void* block) {
+        ThreadCache& cache = threadCache();
+        if (cache.retired || cache.count >= THREAD_CACHE_LIMIT) {
+            releaseShared(block);
+            return;
+        }
+        FreeBlock* node = static_cast<FreeBlock*>(block);
+        node->next = cache.head;
+        cache.head = node;
+        ++cache.count;
+    }
+};
+
+// Standard allocator over BlockPool, for std::allocate_shared: the object
+// and its control block come out of one pooled block. Array requests go
+// to the global heap.
+template <typename T>
+struct PoolAllocator {
+    typedef T value_type;
+
+    static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not pooled");
+
+    PoolAllocator() noexcept {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (n == 1) {
+            return static_cast<T*>(BlockPool<sizeof(T)>::allocate());
+        }
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* pointer, size_t n) noexcept {
+        if (n == 1) {
+            BlockPool<sizeof(T)>::deallocate(pointer);
+        } else {
+            std::allocator<T>().deallocate(pointer, n);
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept { return true; }
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept { return false; }
+
+#endif // BLOCK_POOL_H
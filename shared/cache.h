@@ -1,137 +1,302 @@
 #ifndef CACHE_H
 #define CACHE_H
 
-#include <list>
-#include <unordered_map>
+#include <algorithm>
+#include <cstring>
 #include <mutex>
-#include <chrono>
 #include <memory>
 #include <vector>
 #include "protocol.h"
+#include "timing_wheel.h"
 
+// Lives in a shard's slab for the lifetime of the cache; the LRU links
+// double as the free list while the slot is unused
 struct CacheEntry {
     ChatPacket message;
-    std::chrono::time_point<std::chrono::system_clock> timestamp;
-    uint32_t ttl; // Time-to-live in seconds
+    uint32_t sequence; // Server-assigned, unique within the group
+    uint64_t expiresAt; // CoarseClock milliseconds
+    TimerNode expiryTimer;
+    CacheEntry* newer;
+    CacheEntry* older;
     
-    CacheEntry(const ChatPacket& msg, uint32_t ttlSeconds = 3600) 
-        : message(msg), 
-          timestamp(std::chrono::system_clock::now()),
-          ttl(ttlSeconds) {}
+    CacheEntry() : sequence(0), expiresAt(0), expiryTimer(this), newer(nullptr), older(nullptr) {}
+    
+    CacheEntry(const CacheEntry&) = delete;
+    CacheEntry& operator=(const CacheEntry&) = delete;
     
     bool isExpired() const {
-        auto now = std::chrono::system_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - timestamp);
-        return elapsed.count() > ttl;
+        return CoarseClock::nowMs() >= expiresAt;
     }
 };
 
+// LRU cache split into independently locked shards. Entries are keyed by
+// (groupID, sequence), so every message has a distinct key and concurrent
+// put/get calls on different keys rarely touch the same lock. TTLs are
+// checked against the coarse clock and expired in bulk by a timing wheel
+// per shard, so expiry never walks the whole cache.
+//
+// Each shard allocates all of its entries up front: a slab of entries
+// threaded on an intrusive LRU list, and an open-addressed index from key
+// to entry. Once built, put/get/expiry never touch the heap; a full shard
+// recycles its least recently used entry in place.
 class LRUCache {
 private:
-    size_t capacity;
-    std::list<std::shared_ptr<CacheEntry>> cacheList;
-    std::unordered_map<uint64_t, std::list<std::shared_ptr<CacheEntry>>::iterator> cacheMap;
-    std::mutex cacheMutex;
-    
-    // Statistics
-    uint64_t hits;
-    uint64_t misses;
-    uint64_t evictions;
+    static const uint64_t EXPIRY_TICK_MS = 1000;
     
-    uint64_t makeKey(uint16_t groupID, uint32_t timestamp) {
-        return (static_cast<uint64_t>(groupID) << 32) | timestamp;
+    static uint64_t makeKey(uint16_t groupID, uint32_t sequence) {
+        return (static_cast<uint64_t>(groupID) << 32) | sequence;
     }
     
-public:
-    LRUCache(size_t cap = 100) : capacity(cap), hits(0), misses(0), evictions(0) {}
+    static uint64_t keyOf(const CacheEntry* entry) {
+        return makeKey(entry->message.groupID, entry->sequence);
+    }
     
-    void put(const ChatPacket& packet, uint32_t ttl = 3600) {
-        std::lock_guard<std::mutex> lock(cacheMutex);
+    struct alignas(64) Shard {
+        size_t capacity;
+        size_t used;
+        std::unique_ptr<CacheEntry[]> slab;
+        CacheEntry* freeList;
+        CacheEntry* newest;
+        CacheEntry* oldest;
+        
+        // Linear probing, at most half full, deletion by backward shift so
+        // no tombstones build up
+        std::vector<CacheEntry*> index;
+        size_t indexMask;
+        unsigned indexShift;
         
-        uint64_t key = makeKey(packet.groupID, packet.timestamp);
+        TimingWheel expiryWheel;
+        std::mutex cacheMutex;
         
-        // Remove if already exists
-        auto it = cacheMap.find(key);
-        if (it != cacheMap.end()) {
-            cacheList.erase(it->second);
-            cacheMap.erase(it);
+        // Statistics
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t expirations;
+        
+        explicit Shard(size_t cap)
+            : capacity(cap), used(0), slab(new CacheEntry[cap > 0 ? cap : 1]),
+              freeList(nullptr), newest(nullptr), oldest(nullptr),
+              indexMask(0), indexShift(64),
+              expiryWheel(EXPIRY_TICK_MS, CoarseClock::nowMs()),
+              hits(0), misses(0), evictions(0), expirations(0) {
+            for (size_t i = cap; i > 0; --i) {
+                slab[i - 1].older = freeList;
+                freeList = &slab[i - 1];
+            }
+            size_t slots = 2;
+            unsigned bits = 1;
+            while (slots < cap * 2) {
+                slots <<= 1;
+                ++bits;
+            }
+            index.assign(slots, nullptr);
+            indexMask = slots - 1;
+            indexShift = 64 - bits;
         }
         
-        // Add to front
-        auto entry = std::make_shared<CacheEntry>(packet, ttl);
-        cacheList.push_front(entry);
-        cacheMap[key] = cacheList.begin();
+        // The remaining methods expect cacheMutex to be held
         
-        // Evict if over capacity
-        if (cacheList.size() > capacity) {
-            auto last = cacheList.back();
-            uint64_t evictKey = makeKey(last->message.groupID, last->message.timestamp);
-            cacheMap.erase(evictKey);
-            cacheList.pop_back();
-            evictions++;
+        // Fibonacci hashing on the top bits; shardFor uses the middle ones
+        size_t home(uint64_t key) const {
+            return static_cast<size_t>((key * 0xFF51AFD7ED558CCDULL) >> indexShift);
+        }
+        
+        // Slot holding key, or the empty slot where it would go
+        size_t probe(uint64_t key) const {
+            size_t slot = home(key);
+            while (index[slot] && keyOf(index[slot]) != key) {
+                slot = (slot + 1) & indexMask;
+            }
+            return slot;
+        }
+        
+        void unindex(size_t hole) {
+            size_t slot = hole;
+            while (true) {
+                slot = (slot + 1) & indexMask;
+                CacheEntry* entry = index[slot];
+                if (!entry) break;
+                // Move back unless its home lies after the hole
+                size_t distance = (slot - home(keyOf(entry))) & indexMask;
+                if (distance >= ((slot - hole) & indexMask)) {
+                    index[hole] = entry;
+                    hole = slot;
+                }
+            }
+            index[hole] = nullptr;
+        }
+        
+        void unlink(CacheEntry* entry) {
+            if (entry->newer) entry->newer->older = entry->older; else newest = entry->older;
+            if (entry->older) entry->older->newer = entry->newer; else oldest = entry->newer;
+        }
+        
+        void pushNewest(CacheEntry* entry) {
+            entry->newer = nullptr;
+            entry->older = newest;
+            if (newest) newest->newer = entry; else oldest = entry;
+            newest = entry;
+        }
+        
+        // Remove the entry indexed at slot and return it to the free list
+        void erase(size_t slot) {
+            CacheEntry* entry = index[slot];
+            expiryWheel.cancel(&entry->expiryTimer);
+            unindex(slot);
+            unlink(entry);
+            entry->older = freeList;
+            freeList = entry;
+            --used;
+        }
+    };
+    
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t capacity;
+    
+    // Consecutive sequences of one group should land on different shards
+    Shard& shardFor(uint64_t key) {
+        uint64_t mixed = key * 0x9E3779B97F4A7C15ULL;
+        return *shards[(mixed >> 32) % shards.size()];
+    }
+    
+public:
+    LRUCache(size_t cap = 100, size_t shardCount = 16) : capacity(cap) {
+        if (shardCount == 0) shardCount = 1;
+        if (shardCount > cap) shardCount = cap > 0 ? cap : 1;
+        size_t perShard = (cap + shardCount - 1) / shardCount;
+        for (size_t i = 0; i < shardCount; ++i) {
+            shards.emplace_back(new Shard(perShard));
         }
     }
     
-    bool get(uint16_t groupID, uint32_t timestamp, ChatPacket& packet) {
-        std::lock_guard<std::mutex> lock(cacheMutex);
+    void put(const ChatPacket& packet, uint32_t sequence, uint32_t ttl = 3600) {
+        uint64_t key = makeKey(packet.groupID, sequence);
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.cacheMutex);
+        if (shard.capacity == 0) return;
         
-        uint64_t key = makeKey(groupID, timestamp);
-        auto it = cacheMap.find(key);
+        // Replace in place if it already exists
+        size_t slot = shard.probe(key);
+        CacheEntry* entry = shard.index[slot];
+        if (entry) {
+            shard.unlink(entry);
+        } else {
+            // Evict if at capacity
+            if (shard.used == shard.capacity) {
+                shard.erase(shard.probe(keyOf(shard.oldest)));
+                shard.evictions++;
+                slot = shard.probe(key);
+            }
+            entry = shard.freeList;
+            shard.freeList = entry->older;
+            shard.index[slot] = entry;
+            shard.used++;
+        }
+        
+        // Header plus the bytes in use; the rest of the payload is never read
+        size_t payloadSize = std::min<size_t>(packet.payloadSize, MAX_PAYLOAD_SIZE);
+        memcpy(static_cast<void*>(&entry->message), &packet, PACKET_HEADER_SIZE + payloadSize);
+        if (payloadSize < MAX_PAYLOAD_SIZE) {
+            entry->message.payload[payloadSize] = '\0';
+        }
+        entry->sequence = sequence;
+        entry->expiresAt = CoarseClock::nowMs() + static_cast<uint64_t>(ttl) * 1000;
+        shard.pushNewest(entry);
+        shard.expiryWheel.schedule(&entry->expiryTimer, entry->expiresAt);
+    }
+    
+    bool get(uint16_t groupID, uint32_t sequence, ChatPacket& packet) {
+        uint64_t key = makeKey(groupID, sequence);
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.cacheMutex);
         
-        if (it == cacheMap.end()) {
-            misses++;
+        size_t slot = shard.probe(key);
+        CacheEntry* entry = shard.index[slot];
+        if (!entry) {
+            shard.misses++;
             return false;
         }
         
         // Check TTL
-        if ((*it->second)->isExpired()) {
-            cacheList.erase(it->second);
-            cacheMap.erase(it);
-            misses++;
+        if (entry->isExpired()) {
+            shard.erase(slot);
+            shard.misses++;
+            shard.expirations++;
             return false;
         }
         
         // Move to front (most recently used)
-        cacheList.splice(cacheList.begin(), cacheList, it->second);
-        packet = (*it->second)->message;
-        hits++;
+        shard.unlink(entry);
+        shard.pushNewest(entry);
+        packet = entry->message;
+        shard.hits++;
         return true;
     }
     
+    // Newest first. Scans every shard; the per-group HistoryStore is the
+    // fast path for recent history.
     std::vector<ChatPacket> getGroupHistory(uint16_t groupID, size_t limit = 10) {
-        std::lock_guard<std::mutex> lock(cacheMutex);
-        std::vector<ChatPacket> history;
+        std::vector<std::pair<uint32_t, ChatPacket>> found;
         
-        for (auto& entry : cacheList) {
-            if (entry->message.groupID == groupID && !entry->isExpired()) {
-                history.push_back(entry->message);
-                if (history.size() >= limit) break;
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->cacheMutex);
+            for (CacheEntry* entry = shard->newest; entry; entry = entry->older) {
+                if (entry->message.groupID == groupID && !entry->isExpired()) {
+                    found.emplace_back(entry->sequence, entry->message);
+                }
             }
         }
         
+        std::sort(found.begin(), found.end(),
+                  [](const std::pair<uint32_t, ChatPacket>& a,
+                     const std::pair<uint32_t, ChatPacket>& b) { return a.first > b.first; });
+        
+        std::vector<ChatPacket> history;
+        for (size_t i = 0; i < found.size() && i < limit; ++i) {
+            history.push_back(found[i].second);
+        }
         return history;
     }
     
     void getStats(uint64_t& h, uint64_t& m, uint64_t& e) {
-        std::lock_guard<std::mutex> lock(cacheMutex);
-        h = hits;
-        m = misses;
-        e = evictions;
+        h = m = e = 0;
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->cacheMutex);
+            h += shard->hits;
+            m += shard->misses;
+            e += shard->evictions;
+        }
     }
     
+    uint64_t getExpiredCount() {
+        uint64_t expired = 0;
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->cacheMutex);
+            expired += shard->expirations;
+        }
+        return expired;
+    }
+    
+    // Drop every entry whose TTL has passed. Each shard's wheel hands back
+    // only the entries due since the last call, so the cost follows the
+    // number expired, not the cache size. Call it periodically.
     void clearExpired() {
-        std::lock_guard<std::mutex> lock(cacheMutex);
-        auto it = cacheList.begin();
-        while (it != cacheList.end()) {
-            if ((*it)->isExpired()) {
-                uint64_t key = makeKey((*it)->message.groupID, (*it)->message.timestamp);
-                cacheMap.erase(key);
-                it = cacheList.erase(it);
-            } else {
-                ++it;
-            }
+        uint64_t now = CoarseClock::nowMs();
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->cacheMutex);
+            Shard& current = *shard;
+            current.expiryWheel.advance(now, [&current](TimerNode* timer) {
+                const CacheEntry* entry = static_cast<const CacheEntry*>(timer->owner);
+                current.erase(current.probe(keyOf(entry)));
+                current.expirations++;
+            });
         }
     }
+    
+    size_t getShardCount() const {
+        return shards.size();
+    }
 };
 
 #endif // CACHE_H
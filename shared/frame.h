@@ -0,0 +1,70 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <arpa/inet.h>
+#include "block_pool.h"
+#include "protocol.h"
+
+// An encoded wire frame. Built once in network byte order and never
+// modified afterwards, so any number of send queues can share it.
+// Legacy frames are always sizeof(ChatPacket); v2 and v3 frames stop
+// after the payload, and v3 frames also carry the message's sequence
+// number. Only payloadSize bytes are taken from the packet, since the
+// rest of its buffer is not initialized; legacy padding is zeroed.
+class Frame {
+private:
+    uint16_t length;
+    char bytes[sizeof(ChatPacket) + SEQUENCE_FIELD_SIZE];
+
+public:
+    explicit Frame(const ChatPacket& packet, WireVersion version = WIRE_LEGACY,
+                   uint32_t sequence = 0)
+        : length(static_cast<uint16_t>(wireSize(packet, version))) {
+        // Write each field straight into wire order; no temporary packet
+        char* out = bytes;
+        uint16_t groupID = htons(packet.groupID);
+        uint32_t timestamp = htonl(packet.timestamp);
+        uint32_t senderID = htonl(packet.senderID);
+        uint16_t payloadSize = htons(packet.payloadSize < MAX_PAYLOAD_SIZE
+                                     ? packet.payloadSize
+                                     : static_cast<uint16_t>(MAX_PAYLOAD_SIZE));
+
+        *out++ = static_cast<char>(packet.type);
+        memcpy(out, &groupID, sizeof(groupID));         out += sizeof(groupID);
+        memcpy(out, &timestamp, sizeof(timestamp));     out += sizeof(timestamp);
+        memcpy(out, &senderID, sizeof(senderID));       out += sizeof(senderID);
+        memcpy(out, &payloadSize, sizeof(payloadSize)); out += sizeof(payloadSize);
+        if (version == WIRE_V3) {
+            uint32_t wireSequence = htonl(sequence);
+            memcpy(out, &wireSequence, sizeof(wireSequence));
+            out += sizeof(wireSequence);
+        }
+        size_t copied = ntohs(payloadSize);
+        memcpy(out, packet.payload, copied);
+        memset(out + copied, 0, length - static_cast<size_t>(out - bytes) - copied);
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    // Header fields, read back from the encoded bytes
+    uint8_t type() const { return static_cast<uint8_t>(bytes[0]); }
+    uint16_t groupID() const {
+        uint16_t id;
+        memcpy(&id, bytes + 1, sizeof(id));
+        return ntohs(id);
+    }
+};
+
+// Frame and control block share one pooled block
+typedef std::shared_ptr<const Frame> FramePtr;
+
+inline FramePtr encodeFrame(const ChatPacket& packet, WireVersion version = WIRE_LEGACY,
+                            uint32_t sequence = 0) {
+    return std::allocate_shared<const Frame>(PoolAllocator<Frame>(), packet, version, sequence);
+}
+
+#endif // FRAME_H
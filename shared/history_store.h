@@ -0,0 +1,143 @@
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+#include "protocol.h"
+
+struct HistoryEntry {
+    uint32_t sequence;
+    ChatPacket packet;
+    
+    HistoryEntry(uint32_t seq, const ChatPacket& msg) : sequence(seq), packet(msg) {}
+};
+
+// Fixed-capacity ring of one group's most recent messages. Once full,
+// each append overwrites the oldest slot.
+class GroupHistory {
+private:
+    std::vector<HistoryEntry> ring;
+    size_t capacity;
+    size_t head; // next slot to write once the ring is full
+    std::mutex historyMutex;
+    
+public:
+    explicit GroupHistory(size_t cap) : capacity(cap), head(0) {}
+    
+    void append(const ChatPacket& packet, uint32_t sequence) {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        if (ring.size() < capacity) {
+            ring.emplace_back(sequence, packet);
+            return;
+        }
+        ring[head] = HistoryEntry(sequence, packet);
+        head = (head + 1) % capacity;
+    }
+    
+    // Up to `limit` newest messages with sequence < beforeSequence (0 means
+    // from the newest), oldest first
+    std::vector<HistoryEntry> before(uint32_t beforeSequence, size_t limit) {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        std::vector<HistoryEntry> result;
+        
+        // Oldest entry sits at `head` when full, at 0 otherwise
+        size_t start = (ring.size() < capacity) ? 0 : head;
+        for (size_t i = ring.size(); i > 0 && result.size() < limit; --i) {
+            const HistoryEntry& entry = ring[(start + i - 1) % ring.size()];
+            if (beforeSequence == 0 || entry.sequence < beforeSequence) {
+                result.push_back(entry);
+            }
+        }
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+    
+    // Up to `limit` oldest messages with sequence > afterSequence, oldest first
+    std::vector<HistoryEntry> after(uint32_t afterSequence, size_t limit) {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        std::vector<HistoryEntry> result;
+        
+        size_t start = (ring.size() < capacity) ? 0 : head;
+        for (size_t i = 0; i < ring.size() && result.size() < limit; ++i) {
+            const HistoryEntry& entry = ring[(start + i) % ring.size()];
+            if (entry.sequence > afterSequence) {
+                result.push_back(entry);
+            }
+        }
+        return result;
+    }
+    
+    // Sequence of the oldest message still held, 0 if empty
+    uint32_t oldestSequence() {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        if (ring.empty()) return 0;
+        return ring[(ring.size() < capacity) ? 0 : head].sequence;
+    }
+    
+    size_t size() {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        return ring.size();
+    }
+};
+
+// Per-group recent history. Each group has its own ring and lock, so a busy
+// group neither evicts nor blocks another group's history, and a history
+// page costs O(depth) instead of a scan over every cached message.
+class HistoryStore {
+private:
+    size_t depth;
+    std::unordered_map<uint16_t, std::unique_ptr<GroupHistory>> groups;
+    std::shared_mutex storeMutex;
+    
+    GroupHistory* find(uint16_t groupID) {
+        std::shared_lock<std::shared_mutex> lock(storeMutex);
+        auto it = groups.find(groupID);
+        return (it != groups.end()) ? it->second.get() : nullptr;
+    }
+    
+    GroupHistory* findOrCreate(uint16_t groupID) {
+        GroupHistory* history = find(groupID);
+        if (history) return history;
+        
+        std::unique_lock<std::shared_mutex> lock(storeMutex);
+        auto& slot = groups[groupID];
+        if (!slot) {
+            slot.reset(new GroupHistory(depth));
+        }
+        return slot.get();
+    }
+    
+public:
+    explicit HistoryStore(size_t historyDepth = 50) : depth(historyDepth) {}
+    
+    void append(const ChatPacket& packet, uint32_t sequence) {
+        findOrCreate(packet.groupID)->append(packet, sequence);
+    }
+    
+    std::vector<HistoryEntry> before(uint16_t groupID, uint32_t beforeSequence, size_t limit) {
+        GroupHistory* history = find(groupID);
+        if (!history) return {};
+        return history->before(beforeSequence, limit);
+    }
+    
+    std::vector<HistoryEntry> after(uint16_t groupID, uint32_t afterSequence, size_t limit) {
+        GroupHistory* history = find(groupID);
+        if (!history) return {};
+        return history->after(afterSequence, limit);
+    }
+    
+    uint32_t oldestSequence(uint16_t groupID) {
+        GroupHistory* history = find(groupID);
+        return history ? history->oldestSequence() : 0;
+    }
+    
+    size_t getDepth() const {
+        return depth;
+    }
+};
+
+#endif // HISTORY_STORE_H
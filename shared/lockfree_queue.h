@@ -0,0 +1,102 @@
+#ifndef LOCKFREE_QUEUE_H
+#define LOCKFREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free queue (Vyukov's array queue). Any number of threads may
+// push and pop; each cell carries a sequence number that tells producers and
+// consumers whether it is free or filled, so neither side ever takes a lock.
+// Capacity is rounded up to a power of two. Pushing to a full queue fails
+// instead of blocking, leaving the overflow policy to the caller.
+template <typename T>
+class BoundedQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+    
+    template <typename U>
+    bool push(U&& value) {
+        Cell* cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::forward<U>(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    
+public:
+    explicit BoundedQueue(size_t capacity) : enqueuePos(0), dequeuePos(0) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+    
+    bool tryPush(const T& value) { return push(value); }
+    bool tryPush(T&& value) { return push(std::move(value)); }
+    
+    bool tryPop(T& value) {
+        Cell* cell;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // Approximate; exact only when no other thread is active
+    size_t sizeApprox() const {
+        size_t head = dequeuePos.load(std::memory_order_relaxed);
+        size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+    
+    size_t capacity() const {
+        return mask + 1;
+    }
+};
+
+#endif // LOCKFREE_QUEUE_H
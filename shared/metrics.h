@@ -0,0 +1,247 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Monotonic event count. Each instrument sits on its own cache line so
+// hot counters touched by different threads do not false-share.
+class alignas(64) Counter {
+private:
+    std::atomic<uint64_t> value;
+
+public:
+    Counter() : value(0) {}
+
+    void add(uint64_t n = 1) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+// Current level of something that goes up and down
+class alignas(64) Gauge {
+private:
+    std::atomic<int64_t> value;
+
+public:
+    Gauge() : value(0) {}
+
+    void add(int64_t n) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void set(int64_t n) {
+        value.store(n, std::memory_order_relaxed);
+    }
+
+    int64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+// HDR-style log-linear histogram. Values below 2^SUB_BITS are counted
+// exactly; every power of two above that is split into 2^SUB_BITS equal
+// buckets, so any recorded value is reported within ~3% of its true value
+// across the full 64-bit range. Recording is one relaxed increment on a
+// fixed array, with no locks and no allocation.
+class Histogram {
+private:
+    static const int SUB_BITS = 5;
+    static const uint64_t SUB_COUNT = 1ull << SUB_BITS;
+    static const size_t BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> maxValue;
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < SUB_COUNT) {
+            return static_cast<size_t>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        uint64_t sub = (value >> (msb - SUB_BITS)) & (SUB_COUNT - 1);
+        return static_cast<size_t>((msb - SUB_BITS + 1) * SUB_COUNT + sub);
+    }
+
+    // Largest value that lands in the given bucket
+    static uint64_t bucketUpperBound(size_t index) {
+        uint64_t group = index / SUB_COUNT;
+        uint64_t sub = index % SUB_COUNT;
+        if (group == 0) {
+            return sub;
+        }
+        int msb = static_cast<int>(group) + SUB_BITS - 1;
+        uint64_t width = 1ull << (msb - SUB_BITS);
+        return ((1ull << msb) | (sub << (msb - SUB_BITS))) + (width - 1);
+    }
+
+public:
+    Histogram() : count(0), sum(0), maxValue(0) {
+        for (auto& bucket : buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(uint64_t value) {
+        buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t seen = maxValue.load(std::memory_order_relaxed);
+        while (value > seen &&
+               !maxValue.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t getCount() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getMax() const {
+        return maxValue.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getMean() const {
+        uint64_t n = getCount();
+        return n > 0 ? sum.load(std::memory_order_relaxed) / n : 0;
+    }
+
+    // Value at the given percentile (0-100). Buckets are read while writers
+    // keep recording, so the answer is approximate under load.
+    uint64_t percentile(double p) const {
+        uint64_t total = getCount();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * total);
+        if (rank >= total) rank = total - 1;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                uint64_t bound = bucketUpperBound(i);
+                uint64_t max = getMax();
+                return bound < max ? bound : max;
+            }
+        }
+        return getMax();
+    }
+};
+
+// Nanoseconds on the monotonic clock, for feeding histograms
+inline uint64_t monotonicNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Named instruments. Registration takes a lock and returns a reference
+// that stays valid for the registry's lifetime; recording through that
+// reference never locks. Registering a name twice returns the existing
+// instrument, so several reactors can feed one histogram. Sampled values
+// (cache stats, connection counts) are read through callbacks only when a
+// dump is taken.
+class MetricsRegistry {
+private:
+    struct Entry {
+        std::string name;
+        std::string unit;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        std::function<int64_t()> sample;
+    };
+
+    mutable std::mutex mutex;
+    std::deque<Entry> entries;
+
+    Entry* find(const std::string& name) {
+        for (auto& entry : entries) {
+            if (entry.name == name) return &entry;
+        }
+        return nullptr;
+    }
+
+    Entry& add(const std::string& name, const std::string& unit) {
+        entries.emplace_back();
+        entries.back().name = name;
+        entries.back().unit = unit;
+        return entries.back();
+    }
+
+public:
+    Counter& counter(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* existing = find(name);
+        if (existing && existing->counter) return *existing->counter;
+        Entry& entry = add(name, "");
+        entry.counter.reset(new Counter());
+        return *entry.counter;
+    }
+
+    Gauge& gauge(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* existing = find(name);
+        if (existing && existing->gauge) return *existing->gauge;
+        Entry& entry = add(name, "");
+        entry.gauge.reset(new Gauge());
+        return *entry.gauge;
+    }
+
+    Histogram& histogram(const std::string& name, const std::string& unit) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* existing = find(name);
+        if (existing && existing->histogram) return *existing->histogram;
+        Entry& entry = add(name, unit);
+        entry.histogram.reset(new Histogram());
+        return *entry.histogram;
+    }
+
+    void sampled(const std::string& name, std::function<int64_t()> sample) {
+        std::lock_guard<std::mutex> lock(mutex);
+        add(name, "").sample = std::move(sample);
+    }
+
+    // One line per metric:
+    //   name value
+    //   name count=N mean=X p50=X p99=X p999=X max=X unit
+    std::string dump() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string out;
+        char line[256];
+
+        for (const auto& entry : entries) {
+            if (entry.histogram) {
+                const Histogram& h = *entry.histogram;
+                snprintf(line, sizeof(line),
+                         "%s count=%llu mean=%llu p50=%llu p99=%llu p999=%llu max=%llu %s\n",
+                         entry.name.c_str(),
+                         (unsigned long long)h.getCount(), (unsigned long long)h.getMean(),
+                         (unsigned long long)h.percentile(50), (unsigned long long)h.percentile(99),
+                         (unsigned long long)h.percentile(99.9), (unsigned long long)h.getMax(),
+                         entry.unit.c_str());
+            } else if (entry.counter) {
+                snprintf(line, sizeof(line), "%s %llu\n", entry.name.c_str(),
+                         (unsigned long long)entry.counter->get());
+            } else {
+                int64_t value = entry.gauge ? entry.gauge->get() : entry.sample();
+                snprintf(line, sizeof(line), "%s %lld\n", entry.name.c_str(), (long long)value);
+            }
+            out += line;
+        }
+        return out;
+    }
+};
+
+#endif // METRICS_H
@@ -1,8 +1,10 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
+#include <string>
 #include <arpa/inet.h>
 
 // Message types
@@ -12,11 +14,26 @@ enum MessageType : uint8_t {
     MSG_LEAVE_GROUP = 3,
     MSG_CREATE_GROUP = 4,
     MSG_LIST_GROUPS = 5,
-    MSG_HISTORY = 6,
-    MSG_AUDIO = 7,
+    MSG_HISTORY = 6,    // Paged history; payload is a HistoryCursor (see below)
+    MSG_AUDIO = 7,      // Media offer / upload ticket / notice; payload is a MediaDescriptor
     MSG_VIDEO = 8,
     MSG_ACK = 9,
-    MSG_ERROR = 10
+    MSG_ERROR = 10,
+    MSG_HELLO = 11,     // Wire format negotiation, payload[0] = WireVersion
+    MSG_STATS = 12,     // Metrics request; reply is text chunks ending with an empty one
+    MSG_RESUME = 13     // Session resumption; payload is a ResumeRequest (see below)
+};
+
+// Wire formats. Legacy frames always carry the full 256-byte payload;
+// v2 frames carry the same header followed by exactly payloadSize bytes;
+// v3 frames put a 4-byte message sequence number (0 when the packet is not
+// a stored group message) between the header and the payload.
+// A connection starts in legacy format and switches after a MSG_HELLO
+// exchange, so old clients and servers keep working unchanged.
+enum WireVersion : uint8_t {
+    WIRE_LEGACY = 1,
+    WIRE_V2 = 2,
+    WIRE_V3 = 3
 };
 
 // Binary packet structure
@@ -29,8 +46,11 @@ struct ChatPacket {
     uint16_t payloadSize;   // Size of payload
     char payload[256];      // Message content
     
+    // Only the first payload byte is cleared: the payload is an empty
+    // string until written. Encoding copies just payloadSize bytes, and
+    // Frame zero-fills the rest of a fixed-size legacy frame.
     ChatPacket() : type(0), groupID(0), timestamp(0), senderID(0), payloadSize(0) {
-        memset(payload, 0, sizeof(payload));
+        payload[0] = '\0';
     }
     
     // Convert to network byte order
@@ -51,4 +71,323 @@ struct ChatPacket {
 };
 #pragma pack(pop)
 
+const size_t PACKET_HEADER_SIZE = sizeof(ChatPacket) - sizeof(ChatPacket::payload);
+const size_t MAX_PAYLOAD_SIZE = sizeof(ChatPacket::payload);
+const size_t SEQUENCE_FIELD_SIZE = sizeof(uint32_t);
+
+// MSG_HISTORY request payload: page through one group's messages by
+// sequence number. The reply is up to `limit` MSG_HISTORY packets, oldest
+// first, each a stored message with its original sender and timestamp,
+// followed by one MSG_HISTORY from sender 0 carrying a HistoryPage.
+enum HistoryDirection : uint8_t {
+    HISTORY_BEFORE = 0,  // newest messages with sequence < cursor (0 = from the newest)
+    HISTORY_AFTER = 1    // oldest messages with sequence > cursor
+};
+
+const uint16_t HISTORY_PAGE_MAX = 100;
+
+#pragma pack(push, 1)
+struct HistoryCursor {
+    uint8_t direction;
+    uint32_t sequence;
+    uint16_t limit;
+};
+
+// Closes a history reply. The next page starts before firstSequence or
+// after lastSequence; both are 0 when count is 0.
+struct HistoryPage {
+    uint32_t firstSequence;
+    uint32_t lastSequence;
+    uint16_t count;
+    uint8_t more;         // 1 if further messages exist in the requested direction
+};
+#pragma pack(pop)
+
+inline void writeHistoryCursor(ChatPacket& packet, const HistoryCursor& cursor) {
+    HistoryCursor wire = cursor;
+    wire.sequence = htonl(cursor.sequence);
+    wire.limit = htons(cursor.limit);
+    memcpy(packet.payload, &wire, sizeof(wire));
+    packet.payloadSize = sizeof(wire);
+}
+
+inline bool readHistoryCursor(const ChatPacket& packet, HistoryCursor& cursor) {
+    if (packet.payloadSize < sizeof(cursor)) return false;
+    memcpy(&cursor, packet.payload, sizeof(cursor));
+    cursor.sequence = ntohl(cursor.sequence);
+    cursor.limit = ntohs(cursor.limit);
+    return cursor.direction == HISTORY_BEFORE || cursor.direction == HISTORY_AFTER;
+}
+
+inline void writeHistoryPage(ChatPacket& packet, const HistoryPage& page) {
+    HistoryPage wire = page;
+    wire.firstSequence = htonl(page.firstSequence);
+    wire.lastSequence = htonl(page.lastSequence);
+    wire.count = htons(page.count);
+    memcpy(packet.payload, &wire, sizeof(wire));
+    packet.payloadSize = sizeof(wire);
+}
+
+inline bool readHistoryPage(const ChatPacket& packet, HistoryPage& page) {
+    if (packet.payloadSize < sizeof(page)) return false;
+    memcpy(&page, packet.payload, sizeof(page));
+    page.firstSequence = ntohl(page.firstSequence);
+    page.lastSequence = ntohl(page.lastSequence);
+    page.count = ntohs(page.count);
+    return true;
+}
+
+// MSG_RESUME request payload: the token of the session to resume (all
+// zeros to start a new one), then, for as many groups as fit, the last
+// sequence number the client saw in each. The server restores the
+// session's groups and, per group, replays what came after the client's
+// position (or after the moment it disconnected, for groups it does not
+// list) as one page of MSG_HISTORY packets, so the messages arrive before
+// any newer live ones. The reply, sent first, is a MSG_RESUME carrying a
+// ResumeReply.
+const size_t SESSION_TOKEN_SIZE = 16;
+
+enum ResumeStatus : uint8_t {
+    RESUME_NEW = 0,       // fresh session; nothing was restored
+    RESUME_RESTORED = 1,  // memberships restored, missed messages follow
+    RESUME_EXPIRED = 2    // the presented token is unknown or expired; fresh session
+};
+
+#pragma pack(push, 1)
+struct ResumePosition {
+    uint16_t groupID;
+    uint32_t sequence;
+};
+
+struct ResumeReply {
+    uint8_t token[SESSION_TOKEN_SIZE];
+    uint8_t status;
+    uint16_t groups;       // groups restored
+};
+#pragma pack(pop)
+
+const size_t MAX_RESUME_POSITIONS =
+    (MAX_PAYLOAD_SIZE - SESSION_TOKEN_SIZE - sizeof(uint16_t)) / sizeof(ResumePosition);
+
+// Writes at most MAX_RESUME_POSITIONS positions; returns how many fit
+inline size_t writeResumeRequest(ChatPacket& packet, const uint8_t* token,
+                                 const ResumePosition* positions, size_t count) {
+    if (count > MAX_RESUME_POSITIONS) count = MAX_RESUME_POSITIONS;
+    char* out = packet.payload;
+    memcpy(out, token, SESSION_TOKEN_SIZE);
+    out += SESSION_TOKEN_SIZE;
+    uint16_t wireCount = htons(static_cast<uint16_t>(count));
+    memcpy(out, &wireCount, sizeof(wireCount));
+    out += sizeof(wireCount);
+    for (size_t i = 0; i < count; ++i) {
+        ResumePosition wire;
+        wire.groupID = htons(positions[i].groupID);
+        wire.sequence = htonl(positions[i].sequence);
+        memcpy(out, &wire, sizeof(wire));
+        out += sizeof(wire);
+    }
+    packet.payloadSize = static_cast<uint16_t>(out - packet.payload);
+    return count;
+}
+
+// positions must have room for MAX_RESUME_POSITIONS entries
+inline bool readResumeRequest(const ChatPacket& packet, uint8_t* token,
+                              ResumePosition* positions, size_t& count) {
+    if (packet.payloadSize < SESSION_TOKEN_SIZE + sizeof(uint16_t)) return false;
+    const char* in = packet.payload;
+    memcpy(token, in, SESSION_TOKEN_SIZE);
+    in += SESSION_TOKEN_SIZE;
+    uint16_t wireCount;
+    memcpy(&wireCount, in, sizeof(wireCount));
+    in += sizeof(wireCount);
+    count = ntohs(wireCount);
+    if (count > MAX_RESUME_POSITIONS ||
+        packet.payloadSize < SESSION_TOKEN_SIZE + sizeof(uint16_t) + count * sizeof(ResumePosition)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        memcpy(&positions[i], in, sizeof(ResumePosition));
+        in += sizeof(ResumePosition);
+        positions[i].groupID = ntohs(positions[i].groupID);
+        positions[i].sequence = ntohl(positions[i].sequence);
+    }
+    return true;
+}
+
+inline void writeResumeReply(ChatPacket& packet, const ResumeReply& reply) {
+    ResumeReply wire = reply;
+    wire.groups = htons(reply.groups);
+    memcpy(packet.payload, &wire, sizeof(wire));
+    packet.payloadSize = sizeof(wire);
+}
+
+inline bool readResumeReply(const ChatPacket& packet, ResumeReply& reply) {
+    if (packet.payloadSize < sizeof(reply)) return false;
+    memcpy(&reply, packet.payload, sizeof(reply));
+    reply.groups = ntohs(reply.groups);
+    return true;
+}
+
+inline uint64_t hton64(uint64_t value) {
+    return (static_cast<uint64_t>(htonl(static_cast<uint32_t>(value))) << 32) |
+           htonl(static_cast<uint32_t>(value >> 32));
+}
+
+inline uint64_t ntoh64(uint64_t value) {
+    return hton64(value);
+}
+
+// Media (MSG_AUDIO, MSG_VIDEO) does not travel in ChatPackets; the bytes
+// go over a separate media connection (see MediaRequest) and the chat
+// connection only carries MediaDescriptors, followed by a display name:
+// - a client offers an upload of `size` bytes to groupID (mediaID 0)
+// - the server answers from sender 0 with the ticket: mediaID, key and
+//   the media port to upload to
+// - once the upload completes, the group receives the same descriptor
+//   from the uploader as an ordinary sequenced message
+// The key is a capability: only whoever saw the ticket or the notice can
+// fetch or continue the transfer.
+#pragma pack(push, 1)
+struct MediaDescriptor {
+    uint32_t mediaID;
+    uint64_t key;
+    uint64_t size;
+    uint16_t port;
+};
+#pragma pack(pop)
+
+inline void writeMediaDescriptor(ChatPacket& packet, const MediaDescriptor& media,
+                                 const std::string& name) {
+    MediaDescriptor wire;
+    wire.mediaID = htonl(media.mediaID);
+    wire.key = hton64(media.key);
+    wire.size = hton64(media.size);
+    wire.port = htons(media.port);
+    memcpy(packet.payload, &wire, sizeof(wire));
+    size_t nameLength = std::min(name.size(), MAX_PAYLOAD_SIZE - sizeof(wire) - 1);
+    memcpy(packet.payload + sizeof(wire), name.data(), nameLength);
+    packet.payload[sizeof(wire) + nameLength] = '\0';
+    packet.payloadSize = static_cast<uint16_t>(sizeof(wire) + nameLength);
+}
+
+inline bool readMediaDescriptor(const ChatPacket& packet, MediaDescriptor& media, std::string& name) {
+    if (packet.payloadSize < sizeof(media) || packet.payloadSize > MAX_PAYLOAD_SIZE) return false;
+    memcpy(&media, packet.payload, sizeof(media));
+    media.mediaID = ntohl(media.mediaID);
+    media.key = ntoh64(media.key);
+    media.size = ntoh64(media.size);
+    media.port = ntohs(media.port);
+    name.assign(packet.payload + sizeof(media), packet.payloadSize - sizeof(media));
+    return true;
+}
+
+// Media connection: the client sends one MediaRequest and the server
+// answers with a MediaReply. An upload then streams the bytes from
+// reply.offset (what the server already holds) to the end, and the server
+// confirms with a second MediaReply once they are on disk. A download
+// receives the bytes from the requested offset to the end. Either side
+// resumes after a broken connection by asking again.
+enum MediaOp : uint8_t {
+    MEDIA_UPLOAD = 1,
+    MEDIA_DOWNLOAD = 2
+};
+
+enum MediaStatus : uint8_t {
+    MEDIA_OK = 0,
+    MEDIA_UNKNOWN = 1,     // no such media, or wrong key
+    MEDIA_NOT_READY = 2,   // download of an upload still in progress
+    MEDIA_BUSY = 3,        // another connection is uploading it
+    MEDIA_BAD_OFFSET = 4,  // download offset past the end
+    MEDIA_FAILED = 5       // server-side I/O error
+};
+
+#pragma pack(push, 1)
+struct MediaRequest {
+    uint8_t op;
+    uint32_t mediaID;
+    uint64_t key;
+    uint64_t offset;   // downloads only
+};
+
+struct MediaReply {
+    uint8_t status;
+    uint64_t offset;   // upload: bytes already received; download: first byte sent
+    uint64_t size;
+};
+#pragma pack(pop)
+
+inline void writeMediaRequest(char* out, const MediaRequest& request) {
+    MediaRequest wire = request;
+    wire.mediaID = htonl(request.mediaID);
+    wire.key = hton64(request.key);
+    wire.offset = hton64(request.offset);
+    memcpy(out, &wire, sizeof(wire));
+}
+
+inline void readMediaRequest(const char* in, MediaRequest& request) {
+    memcpy(&request, in, sizeof(request));
+    request.mediaID = ntohl(request.mediaID);
+    request.key = ntoh64(request.key);
+    request.offset = ntoh64(request.offset);
+}
+
+inline void writeMediaReply(char* out, const MediaReply& reply) {
+    MediaReply wire = reply;
+    wire.offset = hton64(reply.offset);
+    wire.size = hton64(reply.size);
+    memcpy(out, &wire, sizeof(wire));
+}
+
+inline void readMediaReply(const char* in, MediaReply& reply) {
+    memcpy(&reply, in, sizeof(reply));
+    reply.offset = ntoh64(reply.offset);
+    reply.size = ntoh64(reply.size);
+}
+
+// Bytes one packet occupies on the wire in the given format
+inline size_t wireSize(const ChatPacket& packet, WireVersion version) {
+    if (version == WIRE_LEGACY) {
+        return sizeof(ChatPacket);
+    }
+    size_t payloadSize = packet.payloadSize < MAX_PAYLOAD_SIZE ? packet.payloadSize : MAX_PAYLOAD_SIZE;
+    size_t headerSize = PACKET_HEADER_SIZE + (version == WIRE_V3 ? SEQUENCE_FIELD_SIZE : 0);
+    return headerSize + payloadSize;
+}
+
+// Decode one frame from the front of a receive buffer into host order.
+// Returns the number of bytes consumed, 0 if the frame is still incomplete,
+// or -1 if the frame is malformed and the stream cannot be resynchronized.
+// The v3 sequence number goes to *sequence when asked for; other formats
+// report 0.
+inline long decodeFrame(const char* data, size_t available, WireVersion version,
+                        ChatPacket& packet, uint32_t* sequence = nullptr) {
+    if (sequence) *sequence = 0;
+    if (version == WIRE_LEGACY) {
+        if (available < sizeof(ChatPacket)) return 0;
+        memcpy(&packet, data, sizeof(ChatPacket));
+        packet.toHostOrder();
+        return sizeof(ChatPacket);
+    }
+
+    size_t headerSize = PACKET_HEADER_SIZE + (version == WIRE_V3 ? SEQUENCE_FIELD_SIZE : 0);
+    if (available < headerSize) return 0;
+    uint16_t payloadSize;
+    memcpy(&payloadSize, data + PACKET_HEADER_SIZE - sizeof(payloadSize), sizeof(payloadSize));
+    payloadSize = ntohs(payloadSize);
+    if (payloadSize > MAX_PAYLOAD_SIZE) return -1;
+    if (available < headerSize + payloadSize) return 0;
+
+    memcpy(static_cast<void*>(&packet), data, PACKET_HEADER_SIZE);
+    if (version == WIRE_V3 && sequence) {
+        memcpy(sequence, data + PACKET_HEADER_SIZE, sizeof(*sequence));
+        *sequence = ntohl(*sequence);
+    }
+    memcpy(packet.payload, data + headerSize, payloadSize);
+    if (payloadSize < sizeof(packet.payload)) {
+        packet.payload[payloadSize] = '\0';
+    }
+    packet.toHostOrder();
+    return static_cast<long>(headerSize + payloadSize);
+}
+
 #endif // PROTOCOL_H
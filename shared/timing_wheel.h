@@ -0,0 +1,189 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+// Milliseconds on the monotonic clock, cached. Hot paths (cache lookups,
+// rate checks) read the cached value with one relaxed load instead of
+// asking the OS for the time; the server refreshes it on every timer tick,
+// so it lags by at most one tick.
+class CoarseClock {
+private:
+    static std::atomic<uint64_t>& cached() {
+        static std::atomic<uint64_t> value(0);
+        return value;
+    }
+
+public:
+    // Read the real clock and publish it
+    static uint64_t tick() {
+        uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+        cached().store(now, std::memory_order_relaxed);
+        return now;
+    }
+
+    static uint64_t nowMs() {
+        uint64_t now = cached().load(std::memory_order_relaxed);
+        return now != 0 ? now : tick();
+    }
+};
+
+// Intrusive timer, embedded in whatever it times. `owner` lets the expiry
+// callback find its way back to the containing object.
+struct TimerNode {
+    TimerNode* prev;
+    TimerNode* next;
+    uint64_t expires;  // in wheel ticks
+    void* owner;
+
+    explicit TimerNode(void* object = nullptr)
+        : prev(nullptr), next(nullptr), expires(0), owner(object) {}
+
+    bool isScheduled() const {
+        return prev != nullptr;
+    }
+};
+
+// Hierarchical timing wheel (Varghese & Lauck): four levels of 64 slots,
+// each level's slot spanning the whole level below. Scheduling and
+// cancelling unlink or link one node; advancing touches only the slots the
+// clock passes, and a timer moves down at most three levels before it
+// fires, so expiry costs amortized O(1) per timer however many are
+// pending. Times are milliseconds rounded up to whole ticks; timers beyond
+// the wheel's span (64^4 ticks) are parked in the last slot and re-filed
+// when they come up. Not thread-safe: the owner serializes access.
+class TimingWheel {
+private:
+    static const unsigned LEVELS = 4;
+    static const unsigned SLOT_BITS = 6;
+    static const unsigned SLOTS = 1u << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+    static const uint64_t SPAN = 1ull << (LEVELS * SLOT_BITS);
+
+    // Circular lists with a sentinel head per slot
+    TimerNode slots[LEVELS][SLOTS];
+    uint64_t tickMs;
+    uint64_t current;  // last tick processed
+    size_t pending;
+
+    static void link(TimerNode& head, TimerNode* node) {
+        node->prev = head.prev;
+        node->next = &head;
+        head.prev->next = node;
+        head.prev = node;
+    }
+
+    static void unlink(TimerNode* node) {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = nullptr;
+        node->next = nullptr;
+    }
+
+    // File a node by how far in the future it expires. `earliest` is the
+    // first tick whose slot has not been processed yet.
+    void place(TimerNode* node, uint64_t earliest) {
+        uint64_t expires = node->expires > earliest ? node->expires : earliest;
+        uint64_t delta = expires - current;
+        if (delta >= SPAN) {
+            expires = current + SPAN - 1;
+            delta = SPAN - 1;
+        }
+        unsigned level = 0;
+        while (delta >= (1ull << ((level + 1) * SLOT_BITS))) {
+            ++level;
+        }
+        link(slots[level][(expires >> (level * SLOT_BITS)) & SLOT_MASK], node);
+    }
+
+    // Re-file every node of one slot against the current tick, whose own
+    // slot is processed right after
+    void cascade(unsigned level, uint64_t index) {
+        TimerNode& head = slots[level][index];
+        while (head.next != &head) {
+            TimerNode* node = head.next;
+            unlink(node);
+            place(node, current);
+        }
+    }
+
+public:
+    TimingWheel(uint64_t tickMilliseconds, uint64_t startMs)
+        : tickMs(tickMilliseconds), current(startMs / tickMilliseconds), pending(0) {
+        for (unsigned level = 0; level < LEVELS; ++level) {
+            for (unsigned slot = 0; slot < SLOTS; ++slot) {
+                slots[level][slot].prev = &slots[level][slot];
+                slots[level][slot].next = &slots[level][slot];
+            }
+        }
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // (Re)schedule a timer to fire at expiresMs
+    void schedule(TimerNode* node, uint64_t expiresMs) {
+        if (node->isScheduled()) {
+            unlink(node);
+        } else {
+            ++pending;
+        }
+        node->expires = (expiresMs + tickMs - 1) / tickMs;
+        place(node, current + 1);
+    }
+
+    void cancel(TimerNode* node) {
+        if (!node->isScheduled()) return;
+        unlink(node);
+        --pending;
+    }
+
+    // Fire, in expiry order per tick, every timer due at or before nowMs.
+    // fire(node) runs with the node already unscheduled and may schedule
+    // it again or cancel other timers.
+    template <typename Fn>
+    void advance(uint64_t nowMs, Fn&& fire) {
+        uint64_t target = nowMs / tickMs;
+        while (current < target) {
+            // Nothing to walk through: jump straight to the target
+            if (pending == 0) {
+                current = target;
+                break;
+            }
+            ++current;
+
+            // Entering a new span at level n re-files that level's slot
+            for (unsigned level = 1; level < LEVELS; ++level) {
+                if ((current & ((1ull << (level * SLOT_BITS)) - 1)) != 0) break;
+                cascade(level, (current >> (level * SLOT_BITS)) & SLOT_MASK);
+            }
+
+            TimerNode& head = slots[0][current & SLOT_MASK];
+            while (head.next != &head) {
+                TimerNode* node = head.next;
+                unlink(node);
+                if (node->expires > current) {
+                    // Parked beyond the span; not due yet
+                    place(node, current + 1);
+                    continue;
+                }
+                --pending;
+                fire(node);
+            }
+        }
+    }
+
+    size_t size() const {
+        return pending;
+    }
+
+    uint64_t getTickMs() const {
+        return tickMs;
+    }
+};
+
+#endif // TIMING_WHEEL_H
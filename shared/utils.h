@@ -7,24 +7,193 @@
 #include <iomanip>
 #include <fstream>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/random.h>
+#include <unistd.h>
+#include "lockfree_queue.h"
 
 class Logger {
 private:
+    // Fixed-size so producers never allocate; longer text is truncated
+    struct LogRecord {
+        std::chrono::system_clock::time_point time;
+        uint32_t userID;
+        uint16_t length;
+        char ipAddress[46];
+        char text[256];
+    };
+    
     std::ofstream logFile;
     std::mutex logMutex;
     
+    // Async mode: producers push into a lock-free ring, one writer thread
+    // formats and writes batches. A full ring drops the record and counts it.
+    std::unique_ptr<BoundedQueue<LogRecord>> ring;
+    std::thread writerThread;
+    std::atomic<bool> asyncRunning;
+    std::atomic<uint32_t> activeProducers;  // log() calls that may still push
+    std::atomic<uint64_t> droppedRecords;
+    std::chrono::milliseconds flushInterval;
+    
+    static void appendRecord(std::string& out, const LogRecord& record,
+                             time_t& cachedSecond, std::string& cachedStamp) {
+        time_t second = std::chrono::system_clock::to_time_t(record.time);
+        if (second != cachedSecond) {
+            struct tm parts;
+            localtime_r(&second, &parts);
+            char stamp[32];
+            strftime(stamp, sizeof(stamp), "[%Y-%m-%d %H:%M:%S] ", &parts);
+            cachedStamp = stamp;
+            cachedSecond = second;
+        }
+        
+        out += cachedStamp;
+        if (record.userID != 0) {
+            out += "UserID:";
+            out += std::to_string(record.userID);
+            out += ' ';
+        }
+        if (record.ipAddress[0] != '\0') {
+            out += "IP:";
+            out += record.ipAddress;
+            out += ' ';
+        }
+        out.append(record.text, record.length);
+        out += '\n';
+    }
+    
+    void writerLoop() {
+        std::string batch;
+        time_t cachedSecond = 0;
+        std::string cachedStamp;
+        uint64_t reportedDrops = 0;
+        auto lastFlush = std::chrono::steady_clock::now();
+        LogRecord record;
+        
+        while (true) {
+            bool running = asyncRunning.load(std::memory_order_acquire);
+            
+            batch.clear();
+            size_t count = 0;
+            while (count < 1024 && ring->tryPop(record)) {
+                appendRecord(batch, record, cachedSecond, cachedStamp);
+                count++;
+            }
+            
+            uint64_t drops = droppedRecords.load(std::memory_order_relaxed);
+            if (drops != reportedDrops) {
+                batch += "[logger] " + std::to_string(drops - reportedDrops) +
+                         " records dropped (ring full)\n";
+                reportedDrops = drops;
+            }
+            
+            auto now = std::chrono::steady_clock::now();
+            if (!batch.empty() || now - lastFlush >= flushInterval) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                if (!batch.empty() && logFile.is_open()) {
+                    logFile.write(batch.data(), batch.size());
+                }
+                if (now - lastFlush >= flushInterval) {
+                    logFile.flush();
+                    lastFlush = now;
+                }
+            }
+            
+            if (count == 0) {
+                if (!running) break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+        
+        std::lock_guard<std::mutex> lock(logMutex);
+        logFile.flush();
+    }
+    
 public:
-    Logger(const std::string& filename) {
+    Logger(const std::string& filename)
+        : asyncRunning(false), activeProducers(0), droppedRecords(0), flushInterval(0) {
         logFile.open(filename, std::ios::app);
     }
     
     ~Logger() {
+        stopAsync();
         if (logFile.is_open()) {
             logFile.close();
         }
     }
     
+    // Switch to asynchronous logging. Records are written in batches and the
+    // file is flushed at most once per flushMs.
+    void startAsync(size_t capacity = 8192, uint32_t flushMs = 200) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (ring) return;
+        flushInterval = std::chrono::milliseconds(flushMs);
+        ring.reset(new BoundedQueue<LogRecord>(capacity));
+        asyncRunning.store(true, std::memory_order_release);
+        writerThread = std::thread(&Logger::writerLoop, this);
+    }
+    
+    // Drain everything already queued, then return to synchronous mode
+    void stopAsync() {
+        if (!asyncRunning.exchange(false)) return;
+        // A producer that saw asyncRunning set may push after the writer's
+        // last pass: wait for those, then write what they left in the ring
+        while (activeProducers.load() != 0) {
+            std::this_thread::yield();
+        }
+        if (writerThread.joinable()) {
+            writerThread.join();
+        }
+        
+        std::string batch;
+        time_t cachedSecond = 0;
+        std::string cachedStamp;
+        LogRecord record;
+        while (ring->tryPop(record)) {
+            appendRecord(batch, record, cachedSecond, cachedStamp);
+        }
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (!batch.empty() && logFile.is_open()) {
+            logFile.write(batch.data(), batch.size());
+            logFile.flush();
+        }
+    }
+    
+    uint64_t getDroppedCount() const {
+        return droppedRecords.load(std::memory_order_relaxed);
+    }
+    
     void log(const std::string& message, uint32_t userID = 0, const std::string& ipAddress = "") {
+        // Announce the push before checking the flag, so stopAsync either
+        // sees this producer or this producer sees async mode off
+        activeProducers.fetch_add(1);
+        if (asyncRunning.load()) {
+            LogRecord record;
+            record.time = std::chrono::system_clock::now();
+            record.userID = userID;
+            size_t ipLength = std::min(ipAddress.size(), sizeof(record.ipAddress) - 1);
+            memcpy(record.ipAddress, ipAddress.data(), ipLength);
+            record.ipAddress[ipLength] = '\0';
+            record.length = static_cast<uint16_t>(std::min(message.size(), sizeof(record.text)));
+            memcpy(record.text, message.data(), record.length);
+            
+            if (!ring->tryPush(record)) {
+                droppedRecords.fetch_add(1, std::memory_order_relaxed);
+            }
+            activeProducers.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+        activeProducers.fetch_sub(1, std::memory_order_relaxed);
+        
         std::lock_guard<std::mutex> lock(logMutex);
         
         auto now = std::chrono::system_clock::now();
@@ -65,4 +234,37 @@ inline std::string formatTimestamp(uint32_t timestamp) {
     return ss.str();
 }
 
+// Bytes from the kernel CSPRNG, for tokens and keys that act as
+// credentials. Falls back to /dev/urandom on kernels without getrandom;
+// with no secure source at all the process stops rather than hand out
+// guessable credentials.
+inline void secureRandom(void* out, size_t length) {
+    char* bytes = static_cast<char*>(out);
+    size_t filled = 0;
+    while (filled < length) {
+        ssize_t got = getrandom(bytes + filled, length - filled, 0);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        filled += static_cast<size_t>(got);
+    }
+    if (filled < length) {
+        int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+        while (fd >= 0 && filled < length) {
+            ssize_t got = read(fd, bytes + filled, length - filled);
+            if (got <= 0) {
+                if (got < 0 && errno == EINTR) continue;
+                break;
+            }
+            filled += static_cast<size_t>(got);
+        }
+        if (fd >= 0) close(fd);
+    }
+    if (filled < length) {
+        std::cerr << "No secure random source available" << std::endl;
+        abort();
+    }
+}
+
 #endif // UTILS_H